@@ -0,0 +1,1015 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <malloc.h>
+#include <unistd.h>
+#include "editor.h"
+#include "highlighter.h"
+#include "rowtree.h"
+#include "search.h"
+#include "screen.h"
+#include "terminal.h"
+
+constexpr const int BENCH_ROWS = 50;
+
+constexpr const int BENCH_COLS = 120;
+
+constexpr const std::size_t BENCH_LINES = 200000;
+
+constexpr const std::size_t BENCH_LONG_LINE = 1 << 22;
+
+constexpr const std::size_t BENCH_REPEAT_LINES = 1000000;
+
+constexpr const std::size_t BENCH_LOG_LINES = 1000000;
+
+constexpr const std::size_t BENCH_VIEW_LIMIT = 1 << 25;
+
+constexpr const std::size_t BENCH_SCAN_LINES = 2000000;
+
+constexpr const int BENCH_SYNTAXES = 100;
+
+constexpr const int BENCH_STARTS = 20;
+
+constexpr const int BENCH_KERNEL_PASSES = 3;
+
+constexpr const std::size_t BENCH_TREE_LINES = 5000000;
+
+constexpr const int BENCH_HEAD_INSERTS = 10000;
+
+constexpr const std::size_t BENCH_SEARCH_BYTES = std::size_t(1) << 30;
+
+constexpr const int BENCH_ROW_EDITS = 10000;
+
+constexpr const int BENCH_FRAME_ROWS = 100;
+
+constexpr const int BENCH_FRAME_COLS = 300;
+
+constexpr const int BENCH_FRAMES = 500;
+
+constexpr const std::size_t BENCH_DENSE_LINES = 50000;
+
+constexpr const std::size_t BENCH_KEYSTROKES = 1000000;
+
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+// Every allocation on any thread, so a save's background writer counts
+// against the keystroke that started it.
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t n) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  free(p);
+}
+
+static std::string key(int c) {
+  switch (c) {
+    case ARROW_UP: return "\x1b[A";
+    case ARROW_DOWN: return "\x1b[B";
+    case ARROW_RIGHT: return "\x1b[C";
+    case ARROW_LEFT: return "\x1b[D";
+    case HOME_KEY: return "\x1b[H";
+    case END_KEY: return "\x1b[F";
+    case PAGE_UP: return "\x1b[5~";
+    case PAGE_DOWN: return "\x1b[6~";
+    case DEL_KEY: return "\x1b[3~";
+  }
+  return std::string(1, c);
+}
+
+static void type(ScriptTerminal& term, std::string_view text) {
+  for (auto c: text) {
+    term.push(key(c == '\n' ? '\r' : c));
+  }
+}
+
+static void paste(ScriptTerminal& term, std::string_view text) {
+  term.push("\x1b[200~" + std::string(text) + "\x1b[201~");
+}
+
+// Runs the editor the way main does until the script is used up and any
+// load or save has finished, then draws once more to answer the last key.
+static void drive(Editor& editor, Screen& screen, ScriptTerminal& term) {
+  while (term.pending() || editor.save || editor.load) {
+    editor.drawFrame(screen);
+    if (!editor.processKeypress(screen)) {
+      return;
+    }
+  }
+  editor.draw(screen);
+}
+
+struct Workload {
+  const char* name;
+  const std::string& file;
+  std::function<void(ScriptTerminal&)> setup;
+  std::function<void(ScriptTerminal&, Editor&, Screen&)> script;
+  std::chrono::nanoseconds pace{0};
+  std::size_t memory_limit{0};
+};
+
+static void report(const Workload& work, const std::vector<KeyStat>& stats,
+std::size_t frames, std::chrono::nanoseconds elapsed) {
+  std::vector<double> latency;
+  std::size_t bytes = 0, probed = 0;
+  for (auto& stat: stats) {
+    latency.push_back(std::chrono::duration<double, std::micro>(
+      stat.latency).count());
+    bytes += stat.bytes;
+    probed += stat.probed;
+  }
+  std::sort(latency.begin(), latency.end());
+  auto n = std::max<std::size_t>(stats.size(), 1);
+  auto pick = [&](std::size_t percent) {
+    return latency.empty() ? 0.0 :
+      latency[std::min(latency.size() - 1, latency.size() * percent / 100)];
+  };
+
+  printf("%-10s %6zu %6zu %10.1f %10.1f %12zu %11.1f %10.1f\n", work.name,
+    stats.size(), frames, pick(50), pick(99), bytes / n,
+    static_cast<double>(probed) / n,
+    std::chrono::duration<double, std::milli>(elapsed).count());
+}
+
+static void run(const Workload& work) {
+  auto owned = std::make_unique<ScriptTerminal>(BENCH_ROWS, BENCH_COLS);
+  ScriptTerminal& term = *owned;
+  term.probe = [] { return allocations.load(std::memory_order_relaxed); };
+
+  Editor editor;
+  Screen screen(std::move(owned));
+  if (work.memory_limit) {
+    editor.memory_limit = work.memory_limit;
+  }
+  editor.openFile(screen, work.file.c_str());
+  if (work.setup) {
+    work.setup(term);
+  }
+  drive(editor, screen, term);
+  term.stats.clear();
+  term.output.clear();
+
+  // Unpaced keys wait for their frame, so a frame rate would only slow
+  // them down. Paced ones arrive regardless and are drawn as main would.
+  if (work.pace.count() == 0) {
+    editor.frame_interval = TimerWheel::Clock::duration::zero();
+  }
+  term.setPace(work.pace);
+  auto frames = term.frames;
+  auto start = std::chrono::steady_clock::now();
+  work.script(term, editor, screen);
+  report(work, term.stats, term.frames - frames,
+    std::chrono::steady_clock::now() - start);
+}
+
+// Resident set size in bytes, mapped file pages included.
+static std::size_t residentBytes() {
+  std::size_t pages = 0, resident = 0;
+  if (FILE* f = fopen("/proc/self/statm", "r")) {
+    if (fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void reportOpen(const char* how, const std::string& file,
+std::size_t lines, std::size_t row_size,
+std::chrono::steady_clock::duration first,
+std::chrono::steady_clock::duration loaded,
+std::chrono::steady_clock::duration closed, std::size_t resident,
+std::size_t allocated) {
+  auto size = std::filesystem::file_size(file);
+  printf("open %s, %s: %zu lines, first frame %.1f ms, loaded %.1f ms, "
+    "closed %.1f ms\n", std::filesystem::path(file).filename().c_str(), how,
+    lines, std::chrono::duration<double, std::milli>(first).count(),
+    std::chrono::duration<double, std::milli>(loaded).count(),
+    std::chrono::duration<double, std::milli>(closed).count());
+  lines = std::max<std::size_t>(lines, 1);
+  printf("  rss %.1f MB, %.2fx the file, %.1f bytes/line over the text "
+    "(%zu per row), %.3f allocs/line\n", resident / 1e6,
+    static_cast<double>(resident) / size,
+    static_cast<double>(resident - std::min(resident, size)) / lines,
+    row_size, static_cast<double>(allocated) / lines);
+}
+
+// How long a file takes to reach its first frame, to load completely and
+// to be closed again, and how much memory and how many allocations it
+// takes once loaded. Memory freed by an earlier open may be reused without
+// showing up, so the first one is the fair one.
+static void open(const std::string& file) {
+  auto owned = std::make_unique<ScriptTerminal>(BENCH_ROWS, BENCH_COLS);
+  ScriptTerminal& term = *owned;
+
+  auto before = residentBytes();
+  auto allocated = allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  auto editor = std::make_unique<Editor>();
+  Screen screen(std::move(owned));
+  editor->openFile(screen, file.c_str());
+  editor->draw(screen);
+  auto first = std::chrono::steady_clock::now();
+  drive(*editor, screen, term);
+  auto loaded = std::chrono::steady_clock::now();
+  auto resident = residentBytes() - std::min(before, residentBytes());
+  allocated = allocations.load(std::memory_order_relaxed) - allocated;
+  auto lines = editor->rows.size();
+  editor.reset();
+  auto closed = std::chrono::steady_clock::now();
+
+  reportOpen("rows", file, lines, sizeof(Row), first - start, loaded - start,
+    closed - loaded, resident, allocated);
+}
+
+// A row as rows were kept before they were made compact: its text, the
+// text with tabs expanded and the highlighting, each in a string of its
+// own.
+struct StringRow {
+  std::string chars;
+  std::string render;
+  Highlight hl;
+};
+
+// The same as open, for file read into a vector of StringRows, as a
+// baseline for the editor's own rows and for the read-only view. Memory
+// it frees is handed back to the system afterwards so later opens start
+// from where they would have.
+static void openStrings(const std::string& file) {
+  auto before = residentBytes();
+  auto allocated = allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  auto rows = std::make_unique<std::vector<StringRow>>();
+  std::ifstream in(file);
+  for (std::string line; std::getline(in, line); ) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    StringRow row = { line, {}, {} };
+    auto tabs = std::count(line.begin(), line.end(), '\t');
+    row.render.resize(line.length() + tabs * (KILO_TAB_STOP - 1));
+    std::size_t rx = 0;
+    for (auto c: line) {
+      if (c == '\t') {
+        row.render[rx++] = ' ';
+        while (rx % KILO_TAB_STOP != 0) {
+          row.render[rx++] = ' ';
+        }
+      } else {
+        row.render[rx++] = c;
+      }
+    }
+    row.render.resize(rx);
+    row.hl.assign(row.render.length(), HL::NORMAL);
+    rows->push_back(std::move(row));
+  }
+  auto loaded = std::chrono::steady_clock::now();
+  auto resident = residentBytes() - std::min(before, residentBytes());
+  allocated = allocations.load(std::memory_order_relaxed) - allocated;
+  auto lines = rows->size();
+  rows.reset();
+  auto closed = std::chrono::steady_clock::now();
+  malloc_trim(0);
+
+  reportOpen("strings", file, lines, sizeof(StringRow), loaded - start,
+    loaded - start, closed - loaded, resident, allocated);
+}
+
+// The same as open, for file shown through the read-only view: the first
+// page is up once it is loaded into rows from the arena, and the file is
+// loaded once the line index reaches its end.
+static void openView(const std::string& file) {
+  auto before = residentBytes();
+  auto allocated = allocations.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  auto view = std::make_unique<FileView>();
+  RowTree rows;
+  view->open(file.c_str(), BENCH_VIEW_LIMIT);
+  view->load(rows, 0);
+  auto first = std::chrono::steady_clock::now();
+  while (!view->indexed()) {
+    std::this_thread::yield();
+  }
+  auto loaded = std::chrono::steady_clock::now();
+  auto resident = residentBytes() - std::min(before, residentBytes());
+  allocated = allocations.load(std::memory_order_relaxed) - allocated;
+  auto lines = view->lines();
+  rows.clear();
+  view.reset();
+  auto closed = std::chrono::steady_clock::now();
+
+  reportOpen("view", file, lines, sizeof(Row), first - start, loaded - start,
+    closed - loaded, resident, allocated);
+}
+
+// How long it takes to bring highlighting down to the last line of a
+// file on threads threads, and how many rows end inside a comment, which
+// should come out the same however many there are.
+static void highlightAll(const std::string& file, unsigned threads) {
+  auto owned = std::make_unique<ScriptTerminal>(BENCH_ROWS, BENCH_COLS);
+  ScriptTerminal& term = *owned;
+  Editor editor;
+  Screen screen(std::move(owned));
+  editor.openFile(screen, file.c_str());
+  drive(editor, screen, term);
+  editor.hl_threads = threads;
+
+  auto start = std::chrono::steady_clock::now();
+  editor.updateSyntax(editor.rows.size() - 1, editor.rows.size(), BENCH_COLS);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  std::size_t open = 0;
+  for (auto& row: std::as_const(editor.rows)) {
+    open += (row.hl_open_comment != 0);
+  }
+  printf("highlight %s: %zu lines, %u thread%s %.1f ms, %zu rows end in a "
+    "comment\n", std::filesystem::path(file).filename().c_str(),
+    editor.rows.size(), threads, (threads == 1) ? "" : "s",
+    std::chrono::duration<double, std::milli>(elapsed).count(), open);
+}
+
+// Highlighting throughput over every line of file, first with the generic
+// highlighter reading the C syntax as it goes and then with the one
+// compiled for C. The checksum of what they paint has to agree.
+static void kernels(const std::string& file) {
+  std::vector<std::string> lines;
+  std::ifstream in(file);
+  std::size_t bytes = 0;
+  for (std::string line; std::getline(in, line); ) {
+    bytes += line.length();
+    lines.push_back(std::move(line));
+  }
+
+  SyntaxDB db;
+  EditorSyntax compiled = *db.find(file);
+  EditorSyntax generic = compiled;
+  generic.highlighter = highlightGeneric;
+
+  for (auto* syntax: { &generic, &compiled }) {
+    Highlight hl;
+    std::size_t sum = 0;
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int pass = 0; pass < BENCH_KERNEL_PASSES; pass++) {
+      sum = 0;
+      int in_comment = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (auto& line: lines) {
+        HLState state = { in_comment, 0, true, false, HL::NORMAL, 0,
+          HL::NORMAL };
+        syntax->highlighter(*syntax, line, line.length(), state, hl);
+        in_comment = state.in_comment;
+        for (std::size_t j = 0; j < hl.length(); j++) {
+          sum += static_cast<std::size_t>(hl[j]) * (j + 1);
+        }
+      }
+      best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    printf("highlight %s, %s: %.1f MB/s, checksum %zx\n",
+      std::filesystem::path(file).filename().c_str(),
+      (syntax == &generic) ? "generic" : "compiled",
+      bytes / std::chrono::duration<double>(best).count() / 1e6, sum);
+  }
+}
+
+// How long pressing Enter at the top of a file of lines lines takes the
+// row store, and how long looking up the row in the middle of it takes
+// afterwards. Both should barely move as the file grows.
+static void headInsert(std::size_t lines) {
+  static const char text[] = "\tstatic int value = 7; // \"note\"";
+  RowTree rows;
+  for (std::size_t i = 0; i < lines; i++) {
+    rows.insert(rows.size(), Row(text, true));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < BENCH_HEAD_INSERTS; k++) {
+    Row row("");
+    row.update();
+    rows.insert(0, std::move(row));
+  }
+  auto inserted = std::chrono::steady_clock::now();
+  std::size_t length = 0;
+  for (int k = 0; k < BENCH_HEAD_INSERTS; k++) {
+    length += std::as_const(rows)[rows.size() / 2 + k].length();
+  }
+  auto found = std::chrono::steady_clock::now();
+
+  printf("insert at head of %zu lines: %.3f us/row, lookup %.3f us/row "
+    "(%zu bytes)\n", lines, std::chrono::duration<double, std::micro>(
+    inserted - start).count() / BENCH_HEAD_INSERTS,
+    std::chrono::duration<double, std::micro>(found - inserted).count() /
+    BENCH_HEAD_INSERTS, length);
+}
+
+static bool isSeparator(int c) {
+  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+// Keyword lookups at every token of file, through a compiled table and
+// through the loop the highlighter had before it, which compared each
+// keyword in turn. Done for the C keywords alone and then with extra
+// made-up ones, as a language with a long list would have.
+static void keywordLookup(const std::string& file) {
+  std::vector<std::string> lines;
+  std::ifstream in(file);
+  for (std::string line; std::getline(in, line); ) {
+    lines.push_back(std::move(line));
+  }
+
+  std::vector<std::string> keywords;
+  for (auto& keyword: CLanguage::keywords) {
+    keywords.push_back(std::string(keyword.word) +
+      ((keyword.kind == HL::KEYWORD2) ? "|" : ""));
+  }
+  for (auto extra: { 0, 100 }) {
+    for (int k = 0; k < extra; k++) {
+      keywords.push_back("word_" + std::to_string(k) + ((k % 3) ? "" : "|"));
+    }
+    KeywordTable table;
+    table.compile(keywords);
+
+    std::size_t tokens = 0, found = 0, looped = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto& line: lines) {
+      for (std::size_t i = 0, end; i < line.length(); i = end + 1) {
+        for (end = i; end < line.length() && !isSeparator(line[end]); end++) {
+        }
+        if (end > i) {
+          found += table.find(std::string_view(line).substr(i, end - i)) !=
+            HL::NORMAL;
+          tokens++;
+        }
+      }
+    }
+    auto hashed = std::chrono::steady_clock::now();
+    for (auto& line: lines) {
+      for (std::size_t i = 0, end; i < line.length(); i = end + 1) {
+        for (end = i; end < line.length() && !isSeparator(line[end]); end++) {
+        }
+        if (end == i) {
+          continue;
+        }
+        for (auto& keyword: keywords) {
+          auto klen = keyword.length();
+          if (keyword[klen - 1] == '|') {
+            klen--;
+          }
+          if (!line.compare(i, klen, keyword, 0, klen) &&
+              isSeparator(line.c_str()[i + klen])) {
+            looped++;
+            break;
+          }
+        }
+      }
+    }
+    auto linear = std::chrono::steady_clock::now();
+
+    printf("keywords %s, %zu words: table %.1f ns/token, loop %.1f ns/token, "
+      "%zu of %zu tokens found (%zu by the loop)\n",
+      std::filesystem::path(file).filename().c_str(), keywords.size(),
+      std::chrono::duration<double, std::nano>(hashed - start).count() /
+      tokens, std::chrono::duration<double, std::nano>(linear - hashed).
+      count() / tokens, found, tokens, looped);
+  }
+}
+
+// Search throughput over BENCH_SEARCH_BYTES of file repeated, counting
+// every match of a few needles of different lengths with findText, with
+// std::string_view::find and with memmem. The counts have to agree.
+static void search(const std::string& file) {
+  std::ifstream in(file, std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+  std::string haystack;
+  haystack.reserve(BENCH_SEARCH_BYTES);
+  while (!text.empty() && haystack.length() < BENCH_SEARCH_BYTES) {
+    haystack.append(text, 0, BENCH_SEARCH_BYTES - haystack.length());
+  }
+  std::string_view h(haystack);
+
+  using Finder = std::size_t (*)(std::string_view, std::string_view,
+    std::size_t);
+  std::pair<const char*, Finder> finders[] = {
+    { "findText", [](std::string_view h, std::string_view n, std::size_t at) {
+      return findText(h, n, at);
+    } },
+    { "string_view", [](std::string_view h, std::string_view n,
+    std::size_t at) {
+      return h.find(n, at);
+    } },
+    { "memmem", [](std::string_view h, std::string_view n, std::size_t at) {
+      auto p = static_cast<const char*>(memmem(h.data() + at, h.length() - at,
+        n.data(), n.length()));
+      return p ? static_cast<std::size_t>(p - h.data()) : h.npos;
+    } },
+  };
+  for (std::string_view needle: { "zq", "WARN", "status=404",
+    "path=/api/v1/items/10006 status=200 bytes=1" }) {
+    printf("search \"%.*s\" in %.0f MB:", static_cast<int>(needle.length()),
+      needle.data(), h.length() / 1e6);
+    for (auto& [name, finder]: finders) {
+      std::size_t count = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (auto at = finder(h, needle, 0); at != h.npos;
+      at = finder(h, needle, at + 1)) {
+        count++;
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      printf(" %s %.2f GB/s (%zu)", name, h.length() /
+        std::chrono::duration<double>(elapsed).count() / 1e9, count);
+    }
+    printf("\n");
+  }
+}
+
+// What an edit in the middle of a single line of length bytes costs, and
+// converting between cursor and render columns on it. The line has a tab
+// every few bytes, as minified code often does, so every step has to
+// account for them. The longest line is past KILO_LONG_LINE and chunked.
+static void longLine(std::size_t length) {
+  std::string piece = "a=b;\tif(c){d()}";
+  std::string text;
+  while (text.length() < length) {
+    text += piece;
+  }
+  Row row(text);
+  row.update();
+  row.cxtorx(0);
+  auto size = row.length();
+
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < BENCH_ROW_EDITS; k++) {
+    row.splice(size / 2, 0, (k % 4) ? "x" : "\t");
+    row.cxtorx(size / 2);
+  }
+  auto edited = std::chrono::steady_clock::now();
+  std::size_t sum = 0;
+  for (int k = 0; k < BENCH_ROW_EDITS; k++) {
+    sum += row.cxtorx(k * UINT64_C(2654435761) % size);
+  }
+  auto converted = std::chrono::steady_clock::now();
+  auto width = std::max(row.cxtorx(row.length()), 1);
+  for (int k = 0; k < BENCH_ROW_EDITS; k++) {
+    sum += row.rxtocx(k * UINT64_C(2654435761) % width);
+  }
+  auto back = std::chrono::steady_clock::now();
+
+  auto each = [](auto elapsed) {
+    return std::chrono::duration<double, std::micro>(elapsed).count() /
+      BENCH_ROW_EDITS;
+  };
+  printf("line of %zu bytes: splice %.3f us, cxtorx %.3f us, rxtocx %.3f us "
+    "(sum %zx)\n", size, each(edited - start), each(converted - edited),
+    each(back - converted), sum);
+}
+
+// The rows of a frame drawn the way drawRows did before it drew spans:
+// each row's render and highlighting copied, then put on screen one
+// character at a time with the colour looked up for each.
+static void drawRowsByChar(Editor& editor, Screen& screen) {
+  auto& rows = editor.rows;
+  std::size_t bottom = std::min(editor.rowoff + screen.rows, rows.size());
+  for (auto j = editor.painted_first;
+  j < std::min(editor.painted_last, rows.size()); j++) {
+    if (j < editor.rowoff || j >= bottom) {
+      rows[j].unpaint();
+    }
+  }
+  editor.painted_first = editor.rowoff;
+  editor.painted_last = bottom;
+  auto it = rows.at(editor.rowoff);
+  for (auto j = editor.rowoff; j < bottom; ++it, ++j) {
+    it->expand();
+  }
+  editor.updateSyntax(editor.rowoff, editor.rowoff + screen.rows,
+    screen.cols);
+
+  for (auto y = 0; y < screen.rows; y++) {
+    std::size_t filerow = y + editor.rowoff;
+    if (filerow >= rows.size()) {
+      screen.printChar('~');
+    } else {
+      std::string render(std::as_const(rows)[filerow].rendered());
+      Highlight hl = std::as_const(rows)[filerow].highlight();
+      int len = std::min<int>(std::max<int>(render.length() - editor.coloff,
+        0), screen.cols);
+      FGColor current_color = FGColor::RESET;
+      for (auto j = 0; j < len; j++) {
+        char c = render[editor.coloff + j];
+        HL kind = (editor.coloff + j < hl.length()) ?
+          hl[editor.coloff + j] : HL::NORMAL;
+        if (iscntrl(c)) {
+          char sym = (c <= 26) ? '@' + c : '?';
+          screen.inverse();
+          screen.printChar(sym);
+          screen.inverse(false);
+          if (current_color != FGColor::RESET) {
+            screen.setFGColor(current_color);
+          }
+        } else if (kind == HL::NORMAL) {
+          if (current_color != FGColor::RESET) {
+            screen.setFGColor(FGColor::RESET);
+            current_color = FGColor::RESET;
+          }
+          screen.printChar(c);
+        } else {
+          FGColor color = syntaxToColor(kind);
+          if (color != current_color) {
+            current_color = color;
+            screen.setFGColor(color);
+          }
+          screen.printChar(c);
+        }
+      }
+      screen.setFGColor(FGColor::RESET);
+    }
+
+    screen.clearToEOL();
+    screen.print("\r\n", 2);
+  }
+}
+
+// What putting the rows of a large terminal full of file on screen costs,
+// while paging down and while the same rows are drawn again, drawn one
+// character at a time as before and in spans by drawRows. Both have to
+// leave the same cells behind.
+static void frames(const std::string& file) {
+  auto owned = std::make_unique<ScriptTerminal>(BENCH_FRAME_ROWS,
+    BENCH_FRAME_COLS);
+  ScriptTerminal& term = *owned;
+  Editor editor;
+  Screen screen(std::move(owned));
+  editor.openFile(screen, file.c_str());
+  drive(editor, screen, term);
+
+  for (bool paging: { true, false }) {
+    std::vector<Cell> cells[2];
+    for (bool spans: { false, true }) {
+      editor.cy = 0;
+      editor.cx = 0;
+      editor.draw(screen);
+      auto start = std::chrono::steady_clock::now();
+      for (int k = 0; k < BENCH_FRAMES; k++) {
+        editor.rowoff = paging ? (k + 1) * screen.rows % editor.rows.size() :
+          0;
+        screen.moveCursor(0, 0);
+        if (spans) {
+          editor.drawRows(screen);
+        } else {
+          drawRowsByChar(editor, screen);
+        }
+      }
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      cells[spans] = screen.back;
+      printf("rows %dx%d, %s, %s: %.1f us/frame\n", BENCH_FRAME_COLS,
+        BENCH_FRAME_ROWS, paging ? "paging" : "redrawn",
+        spans ? "spans" : "per character",
+        std::chrono::duration<double, std::micro>(elapsed).count() /
+        BENCH_FRAMES);
+    }
+    if (cells[0] != cells[1]) {
+      printf("rows %s: the two renderers disagree\n",
+        paging ? "paging" : "redrawn");
+    }
+  }
+}
+
+// What the undo log holds after BENCH_KEYSTROKES keys typed into file,
+// code with a backspace every so often, against keeping a copy of the
+// whole file before every edit the way backups stood in for undo before.
+// Then how long undoing all of it takes, one group at a time.
+static void undoLog(const std::string& file, std::string_view code) {
+  auto owned = std::make_unique<ScriptTerminal>(BENCH_ROWS, BENCH_COLS);
+  ScriptTerminal& term = *owned;
+  Editor editor;
+  Screen screen(std::move(owned));
+  editor.openFile(screen, file.c_str());
+  drive(editor, screen, term);
+  editor.history.limit = std::string::npos;
+  editor.cy = editor.rows.size() / 2;
+
+  std::size_t size = std::filesystem::file_size(file), snapshots = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t k = 0; k < BENCH_KEYSTROKES; k++) {
+    snapshots += size;
+    char c = code[k % code.length()];
+    if (k % 40 == 39 && editor.cx > 0) {
+      editor.delChar();
+      size--;
+    } else if (c == '\n') {
+      editor.insertNewline();
+      size++;
+    } else {
+      editor.insertChar(c);
+      size++;
+    }
+  }
+  auto typed = std::chrono::steady_clock::now();
+  auto groups = editor.history.groups.size();
+  auto memory = editor.history.memory();
+  while (editor.history.current > 0) {
+    editor.undo();
+  }
+  auto undone = std::chrono::steady_clock::now();
+
+  printf("undo %zu keys: %zu groups in %.1f MB (%.1f bytes/key), snapshots "
+    "%.1f GB; typed %.1f ms, undone %.1f ms\n", BENCH_KEYSTROKES, groups,
+    memory / 1e6, static_cast<double>(memory) / BENCH_KEYSTROKES,
+    snapshots / 1e9,
+    std::chrono::duration<double, std::milli>(typed - start).count(),
+    std::chrono::duration<double, std::milli>(undone - typed).count());
+}
+
+// Definitions for BENCH_SYNTAXES made-up languages of a hundred or so
+// keywords each.
+static void writeSyntaxes(const std::string& dir) {
+  std::filesystem::create_directories(dir);
+  for (int k = 0; k < BENCH_SYNTAXES; k++) {
+    std::ofstream out(dir + "/lang" + std::to_string(k) + ".syntax");
+    out << "filetype lang" << k << "\nmatch .l" << k << " .m" << k <<
+      " lang" << k << "rc\n";
+    for (int line = 0; line < 10; line++) {
+      out << ((line % 3) ? "keywords" : "types");
+      for (int w = 0; w < 10; w++) {
+        out << " word" << k << "_" << line << "_" << w;
+      }
+      out << "\n";
+    }
+    out << "comment //\nmultiline /* */\nhighlight numbers strings\n";
+  }
+}
+
+// How long loading the syntax definitions in dir takes at startup, parsed
+// from scratch and then read back from a cache of what they compile to.
+static void startup(const std::string& dir, const std::string& cache) {
+  auto time = [&](bool cached) {
+    std::size_t added = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < BENCH_STARTS; k++) {
+      if (!cached) {
+        std::filesystem::remove(cache);
+      }
+      SyntaxDB db;
+      added = db.load(dir, cache);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    printf("startup with %zu syntaxes, %s: %.3f ms\n", added,
+      cached ? "cached" : "parsed", std::chrono::duration<double,
+      std::milli>(elapsed).count() / BENCH_STARTS);
+  };
+  auto base = std::chrono::steady_clock::now();
+  for (int k = 0; k < BENCH_STARTS; k++) {
+    SyntaxDB db;
+  }
+  printf("startup with built-in syntax only: %.3f ms\n",
+    std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - base).count() / BENCH_STARTS);
+  time(false);
+  time(true);
+}
+
+static void writeSource(const std::string& source, std::size_t lines) {
+  std::ofstream out(source);
+  for (std::size_t i = 0; i < lines; i++) {
+    if (i % 10 == 0) {
+      out << "/* block " << i << " */\n";
+    }
+    out << "\tstatic int value_" << i << " = " << i * 7 <<
+      "; // \"note\" " << (i % 97) << "\n";
+  }
+}
+
+// Lines shaped like a typical service log, around 120 bytes each.
+static void writeLog(const std::string& log, std::size_t lines) {
+  static const char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN" };
+  std::ofstream out(log);
+  char line[256];
+  for (std::size_t i = 0; i < lines; i++) {
+    snprintf(line, sizeof(line), "2024-05-%02zu %02zu:%02zu:%02zu.%03zu %-5s "
+      "[worker-%zu] request id=%08zx path=/api/v1/items/%zu status=200 "
+      "bytes=%zu duration=%zums\n", 1 + i / 86400000 % 28,
+      i / 3600000 % 24, i / 60000 % 60, i / 1000 % 60, i % 1000,
+      levels[i % 5], i % 16, i * 2654435761u % 0xffffffff, i % 10007,
+      i * 37 % 65536, i % 250);
+    out << line;
+  }
+}
+
+// C packed to the width of a large terminal, each line a run of short
+// statements with a keyword, a number, a string and a comment in it.
+static void writeDense(const std::string& dense, std::size_t lines) {
+  std::ofstream out(dense);
+  for (std::size_t i = 0; i < lines; i++) {
+    std::string line;
+    for (int k = 0; line.length() < BENCH_FRAME_COLS - 20; k++) {
+      line += "if (v" + std::to_string(i + k) + " < " +
+        std::to_string(k * 31) + ") s = \"x\"; ";
+    }
+    out << line << "/* end */\n";
+  }
+}
+
+// C with a comment spanning a few lines every so often, so the state a
+// row starts in depends on rows far above it.
+static void writeScan(const std::string& scan, std::size_t lines) {
+  std::ofstream out(scan);
+  for (std::size_t i = 0; i < lines; i++) {
+    if (i % 50 == 0) {
+      out << "/* section " << i << "\n * \"quoted\" // not a comment\n */\n";
+      i += 2;
+    } else {
+      out << "int value_" << i << " = " << i * 7 << "; /* note */\n";
+    }
+  }
+}
+
+static void writeFiles(const std::string& source, const std::string& huge,
+const std::string& line, const std::string& log, const std::string& scan,
+const std::string& dense, std::size_t lines) {
+  writeSource(source, lines);
+  writeSource(huge, BENCH_REPEAT_LINES);
+  writeLog(log, BENCH_LOG_LINES);
+  writeScan(scan, BENCH_SCAN_LINES);
+  writeDense(dense, BENCH_DENSE_LINES);
+
+  std::ofstream wide(line);
+  std::string piece = "int x = 42; /* wide */ \"str\"\t";
+  for (std::size_t n = 0; n < BENCH_LONG_LINE; n += piece.length()) {
+    wide << piece;
+  }
+  wide << "\n";
+}
+
+int main(int argc, const char *argv[]) {
+  std::size_t lines = (argc >= 2) ? strtoull(argv[1], nullptr, 10) :
+    BENCH_LINES;
+
+  char tmpl[] = "/tmp/kilo-bench-XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  std::string dir = tmpl;
+  std::string source = dir + "/source.c";
+  std::string wide = dir + "/wide.c";
+  std::string huge = dir + "/huge.c";
+  std::string log = dir + "/service.log";
+  std::string scan = dir + "/scan.c";
+  std::string dense = dir + "/dense.c";
+  std::string syntaxes = dir + "/syntax";
+
+  try {
+    writeFiles(source, huge, wide, log, scan, dense, lines);
+
+    auto simple = [](std::function<void(ScriptTerminal&)> keys) {
+      return [keys](ScriptTerminal& term, Editor& editor, Screen& screen) {
+        keys(term);
+        drive(editor, screen, term);
+      };
+    };
+    auto middle = [lines](ScriptTerminal& term) {
+      term.push(key(CTRL_KEY('f')));
+      type(term, "value_" + std::to_string(lines / 2) + " ");
+      term.push(key('\r'));
+    };
+
+    std::string code =
+      "for (int i = 0; i < n; i++) {\n  total += \"abc\"[i % 3];\n}\n";
+    std::string block;
+    while (block.length() < (1 << 14)) {
+      block += code;
+    }
+
+    std::vector<Workload> workloads = {
+      { "type", source, middle, simple([&](ScriptTerminal& term) {
+        for (int i = 0; i < 40; i++) {
+          type(term, code);
+        }
+      }) },
+      { "type-wide", wide, [](ScriptTerminal& term) {
+        term.push(key(END_KEY));
+      }, simple([&](ScriptTerminal& term) {
+        for (int i = 0; i < 20; i++) {
+          type(term, "x = y + 1; ");
+        }
+      }) },
+      { "paste", source, middle, simple([&](ScriptTerminal& term) {
+        for (int i = 0; i < 20; i++) {
+          paste(term, block);
+        }
+      }) },
+      { "search", source, nullptr, simple([](ScriptTerminal& term) {
+        term.push(key(CTRL_KEY('f')));
+        type(term, "= 7");
+        for (int i = 0; i < 200; i++) {
+          term.push(key(ARROW_DOWN));
+        }
+        term.push(key(CTRL_KEY('r')));
+        for (int i = 0; i < 200; i++) {
+          term.push(key(ARROW_UP));
+        }
+        term.push(key('\r'));
+      }) },
+      { "scroll", source, nullptr, simple([](ScriptTerminal& term) {
+        for (int i = 0; i < 1000; i++) {
+          term.push(key(PAGE_DOWN));
+        }
+        for (int i = 0; i < 1000; i++) {
+          term.push(key(PAGE_UP));
+        }
+      }) },
+      { "save", source, middle,
+        [](ScriptTerminal& term, Editor& editor, Screen& screen) {
+          for (int i = 0; i < 10; i++) {
+            term.push(key('x'));
+            term.push(key(CTRL_KEY('s')));
+            drive(editor, screen, term);
+          }
+        } },
+      { "repeat-30", huge, nullptr, simple([](ScriptTerminal& term) {
+        for (int i = 0; i < 45; i++) {
+          term.push(key(ARROW_DOWN));
+        }
+        for (int i = 0; i < 45; i++) {
+          term.push(key('x'));
+        }
+      }), std::chrono::nanoseconds(1000000000 / 30) },
+      { "repeat-500", huge, nullptr, simple([](ScriptTerminal& term) {
+        for (int i = 0; i < 250; i++) {
+          term.push(key(PAGE_DOWN));
+        }
+        for (int i = 0; i < 250; i++) {
+          term.push(key('x'));
+        }
+      }), std::chrono::nanoseconds(1000000000 / 500) },
+      { "page-view", log, nullptr, simple([](ScriptTerminal& term) {
+        for (int i = 0; i < 1000; i++) {
+          term.push(key(PAGE_DOWN));
+        }
+      }), std::chrono::nanoseconds(0), BENCH_VIEW_LIMIT },
+    };
+
+    writeSyntaxes(syntaxes);
+    startup(syntaxes, dir + "/syntax.cache");
+    search(log);
+    open(log);
+    openView(log);
+    openStrings(log);
+    open(huge);
+    openView(huge);
+    openStrings(huge);
+    keywordLookup(huge);
+    kernels(huge);
+    kernels(scan);
+    for (unsigned threads: { 1u, 2u, 4u, 8u }) {
+      highlightAll(scan, threads);
+    }
+    for (std::size_t length = 2000; length <= BENCH_LONG_LINE;
+    length *= 10) {
+      longLine(length);
+    }
+    for (auto size: { BENCH_TREE_LINES / 100, BENCH_TREE_LINES / 10,
+      BENCH_TREE_LINES }) {
+      headInsert(size);
+    }
+    frames(dense);
+    undoLog(source, code);
+    printf("%zu lines, %dx%d screen\n", lines, BENCH_COLS, BENCH_ROWS);
+    printf("%-10s %6s %6s %10s %10s %12s %11s %10s\n", "workload", "keys",
+      "frames", "p50 us", "p99 us", "bytes/frame", "allocs/key",
+      "total ms");
+    for (auto& work: workloads) {
+      run(work);
+    }
+  } catch(std::string& e) {
+    fprintf(stderr, "%s\n", e.c_str());
+    std::filesystem::remove_all(dir);
+    return EXIT_FAILURE;
+  }
+
+  std::filesystem::remove_all(dir);
+  return EXIT_SUCCESS;
+}
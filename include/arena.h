@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage for text that rows borrow. Bytes never move once
+// added, so a borrowed Text stays good until the arena is cleared, which
+// frees every block at once.
+struct Arena {
+  Arena();
+
+  std::string_view add(std::string_view);
+  void clear();
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  std::size_t used;
+  std::size_t room;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CHUNKLIST_H
+#define CHUNKLIST_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "highlighter.h"
+#include "text.h"
+
+struct Chunk {
+  Chunk();
+  explicit Chunk(std::string_view, bool = false);
+
+  std::string_view rendered() const;
+
+  Text        chars;
+  std::string render;
+  Highlight   hl;
+  std::size_t cx;
+  std::size_t rx;
+  std::size_t width;
+  std::size_t tabs;
+  HLState     hl_in;
+  HLState     hl_out;
+  bool        stale;
+};
+
+struct ChunkRange {
+  ChunkRange();
+
+  void add(std::size_t);
+  void clip(std::size_t);
+  bool empty() const;
+
+  std::size_t first;
+  std::size_t last;
+};
+
+struct ChunkList {
+  ChunkList(std::string_view, bool);
+
+  std::size_t at(std::size_t) const;
+  std::size_t atRender(std::size_t) const;
+  void clearHighlight(bool = false);
+  std::size_t cxtorx(std::size_t) const;
+  std::size_t find(std::string_view, std::size_t) const;
+  void fit(std::size_t);
+  void layout(std::size_t);
+  std::size_t length() const;
+  void paint(std::size_t, std::size_t, HL);
+  std::size_t rfind(std::string_view, std::size_t) const;
+  std::size_t rxtocx(std::size_t) const;
+  std::string seam(std::size_t, std::size_t) const;
+  void splice(std::size_t, std::size_t, std::string_view);
+  std::string substr(std::size_t, std::size_t = std::string::npos) const;
+  std::size_t width() const;
+
+  std::vector<Chunk> chunks;
+  ChunkRange dirty;
+  ChunkRange painted;
+};
+
+#endif
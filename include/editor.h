@@ -3,35 +3,23 @@
 
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "fileview.h"
+#include "loadjob.h"
+#include "mappedfile.h"
+#include "pattern.h"
 #include "row.h"
+#include "rowtree.h"
+#include "savejob.h"
+#include "syntaxdb.h"
+#include "timerwheel.h"
+#include "undo.h"
 
-enum class HL : unsigned char {
-  NORMAL = 0,
-  COMMENT,
-  MLCOMMENT,
-  KEYWORD1,
-  KEYWORD2,
-  STRING,
-  NUMBER,
-  MATCH
-};
-
-#define HL_HIGHLIGHT_NUMBERS (1<<0)
-#define HL_HIGHLIGHT_STRINGS (1<<1)
-
-struct EditorSyntax {
-  std::string filetype;
-  std::vector<const char*> filematch;
-  std::vector<std::string> keywords;
-  std::string singleline_comment_start;
-  std::string multiline_comment_start;
-  std::string multiline_comment_end;
-  int flags;
-};
-
+enum class FGColor : unsigned char;
 struct Screen;
 
 struct Editor {
@@ -39,27 +27,46 @@ struct Editor {
   ~Editor() {
   }
 
+  void applyUndo(const UndoOp&, bool);
   void delChar();
   void delRow(std::size_t);
   void draw(Screen&);
+  void drawFrame(Screen&);
   void drawMessageBar(Screen&);
   void drawRows(Screen&);
   void drawStatusBar(Screen&);
   void find(Screen&);
+  void finishLoad();
   void findCallback(std::string&, int);
+  void gotoLine(Screen&);
+  void gotoOffset(Screen&);
+  void highlight(std::string_view, std::size_t, HLState&, Highlight&);
+  int  highlightChunks(ChunkList&, int, std::size_t, std::size_t);
+  int  highlightRow(std::string_view, int, Highlight&);
   void insertChar(int);
   void insertNewline();
-  void insertRow(std::size_t, const char*);
+  void insertRow(std::size_t, std::string_view);
+  void insertText(std::string_view);
+  void invalidateSyntax(std::size_t);
+  void jumpTo(Screen&, std::size_t, std::size_t);
+  void loadView(std::size_t);
   void moveCursor(int);
+  void pollLoad();
+  void pollSave();
+  void redo();
   void openFile(Screen&, const char*);
   bool processKeypress(Screen&);
-  std::string prompt(Screen&, const char*,
+  std::string prompt(Screen&, const std::string&,
   std::optional<std::function<void(Editor*, std::string&, int)>>);
   void saveFile(Screen&);
+  void scanSyntax(std::size_t, std::size_t);
   void scroll(Screen&);
   void selectSyntaxHighlight();
   void setStatusMessage(const char *fmt, ...);
-  void updateSyntax(Row& row);
+  void toggleProfile();
+  void undo();
+  void updateSyntax(std::size_t, std::size_t, std::size_t);
+  void writeProfile(Screen&);
 
   Editor(const Editor&)=delete;
   Editor& operator=(const Editor&)=delete;
@@ -68,13 +75,33 @@ struct Editor {
   std::size_t rx;
   std::size_t rowoff;
   std::size_t coloff;
-  std::vector<Row> rows;
+  MappedFile file;
+  std::unique_ptr<FileView> view;
+  std::size_t memory_limit;
+  RowTree rows;
   bool dirty;
   std::filesystem::path filename;
   char statusmsg[80];
   time_t statusmsg_time;
   std::optional<EditorSyntax> syntax;
-  std::vector<EditorSyntax> hldb;
+  std::size_t hl_frontier;
+  Highlight hl_scratch;
+  unsigned hl_threads;
+  std::size_t painted_first;
+  std::size_t painted_last;
+  SyntaxDB hldb;
+  bool find_regex;
+  Pattern find_pattern;
+  std::string find_prompt;
+  UndoLog history;
+  std::unique_ptr<SaveJob> save;
+  std::unique_ptr<LoadJob> load;
+  bool perf_overlay;
+  TimerWheel timers;
+  TimerWheel::Clock::duration frame_interval;
+  TimerWheel::Clock::time_point last_frame;
 };
 
+FGColor syntaxToColor(HL);
+
 #endif
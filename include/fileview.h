@@ -0,0 +1,60 @@
+#ifndef FILEVIEW_H
+#define FILEVIEW_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "rowtree.h"
+
+using BlockMatch = std::function<std::size_t(std::string_view, std::size_t)>;
+
+struct FileView {
+  FileView();
+  ~FileView();
+
+  void close();
+  std::size_t countLines(std::size_t, std::size_t, std::size_t&,
+    std::size_t = std::string::npos);
+  std::size_t find(std::size_t, std::size_t, bool, std::size_t,
+    const BlockMatch&);
+  std::size_t findBackward(std::size_t, std::size_t, std::size_t,
+    std::size_t, const BlockMatch&);
+  std::size_t findForward(std::size_t, std::size_t, std::size_t,
+    std::size_t, const BlockMatch&);
+  bool indexed() const;
+  std::size_t lineAt(std::size_t);
+  std::size_t lineOffset(std::size_t);
+  std::size_t lines() const;
+  void load(RowTree&, std::size_t);
+  bool open(const char*, std::size_t);
+  bool read(std::size_t, std::size_t, std::string&) const;
+  void run();
+
+  FileView(const FileView&)=delete;
+  FileView& operator=(const FileView&)=delete;
+
+  int fd;
+  std::size_t size;
+  std::size_t budget;
+  std::size_t window;
+  std::size_t first;
+  std::size_t known_line;
+  std::size_t known_offset;
+  bool eof;
+  Arena arena;
+
+  std::mutex lock;
+  std::vector<std::size_t> offsets;
+  std::size_t stride;
+  std::atomic<std::size_t> counted;
+  std::atomic<bool> finished;
+  std::atomic<bool> stop;
+  std::thread thread;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef HIGHLIGHTER_H
+#define HIGHLIGHTER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+enum class HL : unsigned char {
+  NORMAL = 0,
+  COMMENT,
+  MLCOMMENT,
+  KEYWORD1,
+  KEYWORD2,
+  STRING,
+  NUMBER,
+  MATCH
+};
+
+using Highlight = std::basic_string<HL>;
+
+struct HLState {
+  bool operator==(const HLState&) const;
+  bool operator!=(const HLState&) const;
+
+  int  in_comment;
+  int  in_string;
+  bool prev_sep;
+  bool line_comment;
+  HL   last;
+  std::size_t carry;
+  HL   carry_hl;
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1<<0)
+#define HL_HIGHLIGHT_STRINGS (1<<1)
+
+struct EditorSyntax;
+
+using Highlighter = void (*)(const EditorSyntax&, std::string_view,
+  std::size_t, HLState&, Highlight&);
+
+struct StaticKeyword {
+  std::string_view word;
+  HL kind;
+};
+
+// A built-in language, known when the editor is compiled. The highlighter
+// made for it has the delimiters and flags folded in and looks keywords up
+// in a table built at compile time.
+struct CLanguage {
+  static constexpr std::string_view filetype = "c";
+  static constexpr std::string_view filematch[] = {
+    ".c", ".h", ".cc", ".cpp"
+  };
+  static constexpr StaticKeyword keywords[] = {
+    { "switch", HL::KEYWORD1 }, { "if", HL::KEYWORD1 },
+    { "while", HL::KEYWORD1 }, { "for", HL::KEYWORD1 },
+    { "break", HL::KEYWORD1 }, { "continue", HL::KEYWORD1 },
+    { "return", HL::KEYWORD1 }, { "else", HL::KEYWORD1 },
+    { "struct", HL::KEYWORD1 }, { "union", HL::KEYWORD1 },
+    { "typedef", HL::KEYWORD1 }, { "static", HL::KEYWORD1 },
+    { "enum", HL::KEYWORD1 }, { "class", HL::KEYWORD1 },
+    { "case", HL::KEYWORD1 },
+    { "int", HL::KEYWORD2 }, { "long", HL::KEYWORD2 },
+    { "double", HL::KEYWORD2 }, { "float", HL::KEYWORD2 },
+    { "char", HL::KEYWORD2 }, { "unsigned", HL::KEYWORD2 },
+    { "signed", HL::KEYWORD2 }, { "void", HL::KEYWORD2 }
+  };
+  static constexpr std::string_view singleline_comment_start = "//";
+  static constexpr std::string_view multiline_comment_start = "/*";
+  static constexpr std::string_view multiline_comment_end = "*/";
+  static constexpr int flags = HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS;
+};
+
+void highlightC(const EditorSyntax&, std::string_view, std::size_t,
+  HLState&, Highlight&);
+void highlightGeneric(const EditorSyntax&, std::string_view, std::size_t,
+  HLState&, Highlight&);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class HL : unsigned char;
+
+// Where a token starts looking in a table of keywords, before masking.
+constexpr std::uint64_t keywordHash(std::string_view token) {
+  auto len = token.length();
+  std::uint32_t last = static_cast<unsigned char>(token[len - 1]);
+  std::uint32_t key = len |
+    static_cast<unsigned char>(token[0]) << 8 |
+    static_cast<unsigned char>(token[len > 1 ? 1 : 0]) << 16 |
+    last << 24;
+  return (key * UINT64_C(0x9E3779B97F4A7C15)) >> 40;
+}
+
+struct Keyword {
+  std::uint32_t offset;
+  std::uint32_t length;
+  HL kind;
+};
+
+// Keywords hashed by length and a few of their bytes. The words are kept
+// back to back in text so a table is a handful of flat arrays, which is
+// what lets a syntax cache read one back without rebuilding it.
+struct KeywordTable {
+  KeywordTable();
+
+  void compile(const std::vector<std::string>&);
+  HL   find(std::string_view) const;
+  std::size_t slot(std::string_view) const;
+  bool valid() const;
+  std::string_view word(const Keyword&) const;
+
+  std::string text;
+  std::vector<Keyword> words;
+  std::vector<int> slots;
+  std::size_t min_length;
+  std::size_t max_length;
+  std::uint64_t first_bytes[4];
+};
+
+#endif
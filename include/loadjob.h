@@ -0,0 +1,37 @@
+#ifndef LOADJOB_H
+#define LOADJOB_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rowtree.h"
+
+struct LoadJob {
+  LoadJob(const char*, std::size_t, std::size_t);
+  ~LoadJob();
+
+  bool done();
+  bool drain(RowTree&, std::chrono::nanoseconds);
+  bool pending();
+  int  progress() const;
+  void run();
+  void wait();
+
+  LoadJob(const LoadJob&)=delete;
+  LoadJob& operator=(const LoadJob&)=delete;
+
+  const char* data;
+  std::size_t size;
+  std::atomic<std::size_t> scanned;
+  std::atomic<bool> finished;
+  std::atomic<bool> stop;
+  std::mutex lock;
+  std::vector<Row> ready;
+  std::vector<Row> taken;
+  std::size_t next;
+  std::thread thread;
+};
+
+#endif
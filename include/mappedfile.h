@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct LineSpan {
+  std::size_t offset;
+  std::size_t length;
+  bool tabs;
+};
+
+struct MappedFile {
+  MappedFile();
+  ~MappedFile();
+
+  void close();
+  bool open(const char*);
+
+  MappedFile(const MappedFile&)=delete;
+  MappedFile& operator=(const MappedFile&)=delete;
+
+  const char* data;
+  std::size_t size;
+  bool mapped;
+  std::string buffer;
+};
+
+std::size_t scanLines(const char*, std::size_t, std::size_t,
+  std::vector<LineSpan>&, std::size_t);
+
+#endif
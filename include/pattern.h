@@ -0,0 +1,61 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <bitset>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using ByteSet = std::bitset<256>;
+
+enum class NfaKind : unsigned char {
+  BYTES,
+  SPLIT,
+  BOL,
+  EOL,
+  MATCH
+};
+
+struct NfaState {
+  NfaKind kind;
+  ByteSet bytes;
+  int out;
+  int out1;
+};
+
+struct Automaton {
+  Automaton();
+
+  bool accepts(int, bool) const;
+  void clear();
+  int  add(std::vector<int>&&);
+  void closure(std::vector<int>&, bool, bool) const;
+  int  start(bool);
+  int  step(int, unsigned char);
+
+  std::vector<NfaState> nfa;
+  int nfa_start;
+  std::vector<int> table;
+  std::vector<std::vector<int>> sets;
+  std::vector<unsigned char> flags;
+  std::map<std::vector<int>, int> cache;
+  int starts[2];
+};
+
+struct Pattern {
+  Pattern();
+
+  bool compile(std::string_view);
+  std::size_t find(std::string_view, std::size_t, std::size_t&);
+  std::size_t longest(std::string_view, std::size_t);
+  std::size_t rfind(std::string_view, std::size_t, std::size_t&);
+
+  std::string error;
+  std::string required;
+  Automaton forward;
+  Automaton reverse;
+  unsigned char skip[256];
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class Phase : unsigned char {
+  INPUT,
+  EDIT,
+  HIGHLIGHT,
+  RENDER,
+  WRITE,
+  WAIT
+};
+
+constexpr const std::size_t PROFILE_PHASES = 6;
+
+// Durations in nanoseconds, bucketed by power of two with four linear
+// steps inside each, so a percentile is good to within 25%.
+struct Histogram {
+  Histogram();
+
+  void add(std::uint64_t);
+  static std::uint64_t lower(std::size_t);
+  std::uint64_t percentile(unsigned) const;
+
+  std::uint64_t buckets[256];
+  std::uint64_t count;
+  std::uint64_t total;
+  std::uint64_t max;
+};
+
+struct Profile {
+  Profile();
+
+  void addBytes(std::size_t);
+  std::string dump() const;
+  std::string overlay() const;
+  void reset();
+
+  std::atomic<bool> enabled;
+  std::atomic<std::size_t> allocations;
+  Histogram phases[PROFILE_PHASES];
+  std::size_t bytes;
+  std::size_t frames;
+};
+
+extern Profile profile;
+
+// Times its scope into a phase's histogram, less any time spent in nested
+// scopes, so the phases add up to where the time went.
+struct ProfileScope {
+  explicit ProfileScope(Phase);
+  ~ProfileScope();
+
+  ProfileScope(const ProfileScope&)=delete;
+  ProfileScope& operator=(const ProfileScope&)=delete;
+
+  Phase phase;
+  bool on;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::nanoseconds nested;
+  ProfileScope* parent;
+};
+
+#ifdef KILO_PROFILE
+#define PROFILE(phase) ProfileScope profile_scope(phase)
+#define PROFILE_BYTES(n) profile.addBytes(n)
+#else
+#define PROFILE(phase)
+#define PROFILE_BYTES(n)
+#endif
+
+#endif
@@ -1,28 +1,79 @@
 #ifndef ROW_H
 #define ROW_H
 
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "chunklist.h"
+#include "text.h"
 
-enum class HL : unsigned char;
+constexpr const std::size_t KILO_TAB_STOP = 8;
 
-using Highlight = std::basic_string<HL>;
+static inline std::size_t tabEnd(std::size_t rx) {
+  return (rx / KILO_TAB_STOP + 1) * KILO_TAB_STOP;
+}
+
+struct TabStop {
+  std::size_t cx;
+  std::size_t rx;
+};
+
+struct Expansion {
+  Expansion() : render{}, stops{} {
+  }
+
+  std::string render;
+  std::vector<TabStop> stops;
+};
+
+// What only some rows need, kept apart so the rest stay small: the
+// expansion of a row with tabs, the chunks of a long one and the
+// highlighting of one on screen.
+struct RowExtra {
+  RowExtra();
+  RowExtra(const RowExtra&);
+
+  RowExtra& operator=(const RowExtra&)=delete;
+
+  std::unique_ptr<Expansion> tabs;
+  std::unique_ptr<ChunkList> chunks;
+  Highlight   hl;
+};
 
 struct Row {
-  explicit Row(std::size_t, const char*);
+  explicit Row(std::string_view, bool = false);
+  Row(const Row&);
+  Row(Row&&) = default;
 
-  void append(std::string);
-  void erase(std::size_t);
+  Row& operator=(const Row&);
+  Row& operator=(Row&&) = default;
+
+  void append(std::string_view);
+  ChunkList* chunks() const;
+  void erase(std::size_t, std::size_t = 1);
+  void expand();
+  const Highlight& highlight() const;
   void insert(std::size_t, int);
+  void insert(std::size_t, std::string_view);
+  std::size_t length() const;
+  Highlight& paint();
+  std::string_view rendered() const;
+  void splice(std::size_t, std::size_t, std::string_view);
+  Expansion* tabs() const;
+  std::string text(std::size_t = 0, std::size_t = std::string::npos) const;
+  void trim();
+  void unpaint();
   void update();
 
   int  cxtorx(int);
   std::size_t rxtocx(int);
 
-  std::size_t idx;
-  std::string chars;
-  std::string render;
-  Highlight   hl;
-  int         hl_open_comment;
+  Text        chars;
+  std::unique_ptr<RowExtra> extra;
+  signed char hl_start;
+  signed char hl_open_comment;
+  bool        tabbed;
 };
 
-#endif
\ No newline at end of file
+#endif
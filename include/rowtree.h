@@ -0,0 +1,63 @@
+#ifndef ROWTREE_H
+#define ROWTREE_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "row.h"
+
+struct RowTree {
+  struct Node;
+
+  struct iterator {
+    iterator();
+    explicit iterator(bool);
+
+    Row& operator*() const;
+    Row* operator->() const;
+    iterator& operator++();
+    bool operator==(const iterator&) const;
+    bool operator!=(const iterator&) const;
+
+    std::vector<std::pair<Node*, std::size_t>> path;
+    bool cow;
+  };
+
+  struct const_iterator {
+    explicit const_iterator(iterator&&);
+
+    const Row& operator*() const;
+    const Row* operator->() const;
+    const_iterator& operator++();
+    bool operator==(const const_iterator&) const;
+    bool operator!=(const const_iterator&) const;
+
+    iterator it;
+  };
+
+  RowTree();
+  RowTree(const RowTree&);
+  ~RowTree();
+
+  Row& operator[](std::size_t);
+  const Row& operator[](std::size_t) const;
+  iterator at(std::size_t);
+  const_iterator at(std::size_t) const;
+  iterator begin();
+  const_iterator begin() const;
+  void clear();
+  iterator end();
+  const_iterator end() const;
+  void erase(std::size_t);
+  void insert(std::size_t, Row&&);
+  std::size_t lineAt(std::size_t) const;
+  std::size_t lineOffset(std::size_t) const;
+  std::size_t size() const;
+
+  RowTree& operator=(const RowTree&)=delete;
+
+  std::shared_ptr<Node> root;
+};
+
+#endif
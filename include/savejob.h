@@ -0,0 +1,35 @@
+#ifndef SAVEJOB_H
+#define SAVEJOB_H
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include "rowtree.h"
+
+struct SaveJob {
+  SaveJob(const RowTree&, const std::filesystem::path&);
+  ~SaveJob();
+
+  bool done() const;
+  void fail(const char*);
+  bool flush(int, struct iovec*, std::size_t);
+  int  progress() const;
+  void run();
+  bool writeRows(int);
+
+  SaveJob(const SaveJob&)=delete;
+  SaveJob& operator=(const SaveJob&)=delete;
+
+  const RowTree rows;
+  std::filesystem::path target;
+  mode_t mode;
+  std::atomic<std::size_t> rows_written;
+  std::atomic<std::size_t> bytes_written;
+  std::atomic<bool> finished;
+  std::string error;
+  std::thread thread;
+};
+
+#endif
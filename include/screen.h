@@ -1,10 +1,12 @@
 #ifndef SCREEN_H
 #define SCREEN_H
 
+#include <memory>
 #include <string>
-#include <termios.h>
+#include <vector>
+#include "terminal.h"
 
-enum class FGColor {
+enum class FGColor : unsigned char {
   BLACK   = 30,
   RED     = 31,
   GREEN   = 32,
@@ -26,11 +28,26 @@ enum editorKey {
   HOME_KEY,
   END_KEY,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  PASTE,
+  RESIZE,
+  TIMEOUT
+};
+
+constexpr const int SCREEN_ESC_TIMEOUT = 100;
+
+struct Cell {
+  bool operator==(const Cell&) const;
+  bool operator!=(const Cell&) const;
+
+  char    ch;
+  FGColor fg;
+  bool    inverse;
 };
 
 struct Screen {
   Screen();
+  explicit Screen(std::unique_ptr<Terminal>);
   ~Screen();
 
   bool clear();
@@ -38,22 +55,45 @@ struct Screen {
   void die(const char*);
   void disableRawMode();
   void enableRawMode();
-  bool getCursorPosition();
+  bool fillInput(int);
   bool getWindowSize();
   void hideCursor();
+  bool inputPending();
   void inverse(bool = true);
   void moveCursor(std::size_t, std::size_t);
   void print(const char*, std::size_t);
   void printChar(const char);
-  int  readKey();
+  void printSpan(const char*, std::size_t, FGColor);
+  int  readKey(int = -1);
+  void readPaste();
   void refresh();
+  void resize();
   void setFGColor(FGColor);
   void showCursor();
+  char takeInput();
+  bool wantInput(std::size_t, int = SCREEN_ESC_TIMEOUT);
 
+  std::unique_ptr<Terminal> term;
   int cols;
   int rows;
-  struct termios orig_termios;
   std::string ab;
+
+  std::vector<Cell> front;
+  std::vector<Cell> back;
+  bool invalid;
+  int  x, y;
+  Cell pen;
+  bool cursor_visible;
+  int  term_x, term_y;
+  Cell term_pen;
+  bool term_cursor_visible;
+  std::size_t frame_bytes;
+  std::size_t total_bytes;
+
+  std::vector<char> input;
+  std::size_t in_head, in_tail;
+  bool resized;
+  std::string paste;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,10 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstddef>
+#include <string_view>
+
+std::size_t findText(std::string_view, std::string_view, std::size_t = 0);
+std::size_t rfindText(std::string_view, std::string_view, std::size_t);
+
+#endif
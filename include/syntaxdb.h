@@ -0,0 +1,41 @@
+#ifndef SYNTAXDB_H
+#define SYNTAXDB_H
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "highlighter.h"
+#include "keywords.h"
+
+struct EditorSyntax {
+  std::string filetype;
+  std::vector<std::string> filematch;
+  std::string singleline_comment_start;
+  std::string multiline_comment_start;
+  std::string multiline_comment_end;
+  int flags;
+  KeywordTable keyword_table;
+  Highlighter highlighter;
+};
+
+// Every syntax the editor knows, built in or read from definition files,
+// with extensions hashed to the syntax they select. Matches that are not
+// extensions are looked for in the file name in the order they came.
+struct SyntaxDB {
+  SyntaxDB();
+
+  void add(EditorSyntax&&);
+  const EditorSyntax* find(const std::filesystem::path&) const;
+  std::size_t load(const std::filesystem::path&,
+    const std::filesystem::path&);
+
+  std::vector<EditorSyntax> syntaxes;
+  std::unordered_map<std::string, std::size_t> extensions;
+  std::vector<std::pair<std::string, std::size_t>> names;
+};
+
+bool parseSyntax(const std::filesystem::path&, EditorSyntax&);
+
+#endif
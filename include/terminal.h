@@ -0,0 +1,94 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <termios.h>
+#include <sys/types.h>
+
+// The byte stream a Screen draws to and reads keys from. Calls that fail
+// leave errno set for Screen::die.
+struct Terminal {
+  enum : int {
+    READABLE = 1,
+    RESIZED  = 2
+  };
+
+  virtual ~Terminal();
+
+  virtual bool    disableRawMode() = 0;
+  virtual bool    enableRawMode() = 0;
+  virtual bool    getWindowSize(int&, int&) = 0;
+  virtual int     poll(int) = 0;
+  virtual bool    present(const char*, std::size_t);
+  virtual ssize_t read(char*, std::size_t) = 0;
+  virtual bool    write(const char*, std::size_t) = 0;
+};
+
+struct TTYTerminal : Terminal {
+  TTYTerminal();
+
+  bool    disableRawMode() override;
+  bool    enableRawMode() override;
+  bool    getCursorPosition(int&, int&);
+  bool    getWindowSize(int&, int&) override;
+  int     poll(int) override;
+  ssize_t read(char*, std::size_t) override;
+  bool    write(const char*, std::size_t) override;
+
+  struct termios orig_termios;
+  struct sigaction orig_winch;
+};
+
+struct KeyStat {
+  std::chrono::nanoseconds latency;
+  std::size_t bytes;
+  std::size_t probed;
+};
+
+struct KeyArrival {
+  std::chrono::steady_clock::time_point at;
+  std::size_t probed;
+};
+
+// An in-memory terminal that plays back queued keystrokes and keeps what
+// is written to it. Every key gets a KeyStat when the next frame is
+// presented: the time from its arrival to that frame, the frame's size and
+// how far probe, if set, moved in between. Unpaced, a key arrives once the
+// frame answering the one before it is out. Paced, keys arrive on a clock
+// whether or not the editor has kept up, like a held-down key.
+struct ScriptTerminal : Terminal {
+  ScriptTerminal(int, int);
+
+  bool    available() const;
+  bool    disableRawMode() override;
+  bool    enableRawMode() override;
+  bool    getWindowSize(int&, int&) override;
+  bool    pending() const;
+  int     poll(int) override;
+  bool    present(const char*, std::size_t) override;
+  void    push(std::string_view);
+  ssize_t read(char*, std::size_t) override;
+  void    setPace(std::chrono::nanoseconds);
+  bool    write(const char*, std::size_t) override;
+
+  int rows;
+  int cols;
+  std::deque<std::string> keys;
+  std::size_t offset;
+  std::chrono::nanoseconds pace;
+  std::chrono::steady_clock::time_point next_due;
+  std::vector<KeyArrival> unanswered;
+  std::function<std::size_t()> probe;
+
+  std::string output;
+  std::size_t frames;
+  std::vector<KeyStat> stats;
+};
+
+#endif
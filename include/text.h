@@ -0,0 +1,43 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A row's bytes, either borrowed from the mapped file or in a buffer of its
+// own. A Text with no capacity borrows. Lengths fit in 32 bits because
+// rows that long are cut into chunks.
+struct Text {
+  Text();
+  explicit Text(std::string_view, bool = false);
+  Text(const Text&);
+  Text(Text&&) noexcept;
+  ~Text();
+
+  Text& operator=(const Text&);
+  Text& operator=(Text&&) noexcept;
+
+  const char* begin() const;
+  bool borrowed() const;
+  const char* data() const;
+  bool empty() const;
+  const char* end() const;
+  std::size_t length() const;
+  std::string substr(std::size_t, std::size_t = std::string::npos) const;
+  char operator[](std::size_t) const;
+  operator std::string_view() const;
+
+  void append(std::string_view);
+  void erase(std::size_t, std::size_t = std::string::npos);
+  void insert(std::size_t, std::size_t, char);
+  void insert(std::size_t, std::string_view);
+  void own();
+  void reserve(std::size_t);
+
+  const char* bytes;
+  std::uint32_t size;
+  std::uint32_t capacity;
+};
+
+#endif
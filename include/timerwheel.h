@@ -0,0 +1,36 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+struct Timer {
+  int id;
+  std::size_t rounds;
+  std::function<void()> fire;
+};
+
+// One-shot timers hashed into a ring of slots by the tick they are due.
+// A timer further out than one turn of the ring waits out its rounds in
+// its slot, so scheduling, cancelling and expiring never sort anything.
+struct TimerWheel {
+  using Clock = std::chrono::steady_clock;
+
+  TimerWheel();
+
+  void cancel(int);
+  bool empty() const;
+  void expire();
+  int  next() const;
+  void schedule(int, Clock::duration, std::function<void()>);
+
+  std::size_t tickAt(Clock::time_point) const;
+
+  std::vector<std::vector<Timer>> slots;
+  Clock::time_point origin;
+  std::size_t tick;
+  std::size_t count;
+};
+
+#endif
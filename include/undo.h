@@ -0,0 +1,54 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class UndoKind : unsigned char {
+  INSERT,
+  ERASE,
+  INSERT_ROW,
+  DELETE_ROW
+};
+
+struct UndoOp {
+  std::size_t row;
+  std::size_t col;
+  std::size_t offset;
+  std::uint32_t length;
+  UndoKind kind;
+  bool reversed;
+};
+
+struct UndoGroup {
+  std::size_t first;
+  std::size_t cx_before, cy_before;
+  std::size_t cx_after, cy_after;
+};
+
+struct UndoLog {
+  UndoLog();
+
+  void add(UndoKind, std::size_t, std::size_t, std::string_view, bool = false);
+  void close(std::size_t, std::size_t);
+  std::size_t last(std::size_t) const;
+  bool merge(UndoKind, std::size_t, std::size_t, char);
+  std::size_t memory() const;
+  void open(std::size_t, std::size_t);
+  std::string text(const UndoOp&) const;
+  void trim();
+
+  std::string arena;
+  std::vector<UndoOp> ops;
+  std::vector<UndoGroup> groups;
+  std::size_t current;
+  std::size_t limit;
+  int depth;
+  bool started;
+  bool sealed;
+  std::size_t open_cx, open_cy;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include <algorithm>
+#include <cstring>
+#include "arena.h"
+
+constexpr const std::size_t ARENA_BLOCK = 1 << 20;
+
+Arena::Arena() : blocks{}, used{0}, room{0} {
+}
+
+// Copies s in and returns where it now lives. Text longer than a block
+// gets a block of its own.
+std::string_view Arena::add(std::string_view s) {
+  if (s.empty()) {
+    return {};
+  }
+  if (s.length() > room - used) {
+    room = std::max(ARENA_BLOCK, s.length());
+    used = 0;
+    blocks.emplace_back(new char[room]);
+  }
+  char* p = blocks.back().get() + used;
+  memcpy(p, s.data(), s.length());
+  used += s.length();
+  return std::string_view(p, s.length());
+}
+
+void Arena::clear() {
+  blocks.clear();
+  used = room = 0;
+}
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <iterator>
+#include "chunklist.h"
+#include "row.h"
+#include "search.h"
+
+constexpr const std::size_t KILO_CHUNK = 1 << 12;
+
+constexpr const HLState HL_DIRTY = { -1, 0, true, false, HL{}, 0, HL{} };
+
+Chunk::Chunk() : Chunk(std::string_view()) {
+}
+
+Chunk::Chunk(std::string_view s, bool borrowed) : chars{s, borrowed},
+render{}, hl{}, cx{0}, rx{0}, width{0}, tabs{0}, hl_in{HL_DIRTY},
+hl_out{HL_DIRTY}, stale{true} {
+}
+
+std::string_view Chunk::rendered() const {
+  return tabs ? std::string_view(render) : std::string_view(chars);
+}
+
+ChunkRange::ChunkRange() : first{0}, last{0} {
+}
+
+void ChunkRange::add(std::size_t j) {
+  if (empty()) {
+    first = j;
+    last = j + 1;
+  } else {
+    first = std::min(first, j);
+    last = std::max(last, j + 1);
+  }
+}
+
+// Forgets everything from n on.
+void ChunkRange::clip(std::size_t n) {
+  last = std::min(last, n);
+  if (first >= last) {
+    first = last = 0;
+  }
+}
+
+bool ChunkRange::empty() const {
+  return first >= last;
+}
+
+// Cuts text into pieces of between two thirds and one KILO_CHUNK.
+static std::vector<Chunk> cut(std::string_view text, bool borrowed) {
+  auto count = std::max<std::size_t>(1,
+    (text.length() + KILO_CHUNK - 1) / KILO_CHUNK);
+  auto size = std::max<std::size_t>(1, (text.length() + count - 1) / count);
+  std::vector<Chunk> pieces;
+  pieces.reserve(count);
+  for (std::size_t pos = 0; pos < text.length(); pos += size) {
+    pieces.emplace_back(text.substr(pos, size), borrowed);
+  }
+  if (pieces.empty()) {
+    pieces.emplace_back();
+  }
+  return pieces;
+}
+
+// Expands the tabs of a chunk that starts at render column rx. Only the
+// column modulo KILO_TAB_STOP matters, so a chunk keeps its render when
+// an edit before it shifts it by whole tab stops.
+static void expand(Chunk& chunk, std::size_t rx) {
+  std::string_view text = chunk.chars;
+  chunk.tabs = std::count(text.begin(), text.end(), '\t');
+  chunk.rx = rx;
+  chunk.stale = false;
+  chunk.hl.clear();
+  chunk.hl_in = HL_DIRTY;
+  chunk.render.clear();
+  if (!chunk.tabs) {
+    chunk.render.shrink_to_fit();
+    chunk.width = text.length();
+    return;
+  }
+
+  chunk.render.reserve(text.length() + chunk.tabs * (KILO_TAB_STOP - 1));
+  std::size_t col = rx;
+  for (auto c: text) {
+    if (c == '\t') {
+      chunk.render.append(tabEnd(col) - col, ' ');
+      col = tabEnd(col);
+    } else {
+      chunk.render += c;
+      col++;
+    }
+  }
+  chunk.width = col - rx;
+}
+
+ChunkList::ChunkList(std::string_view s, bool borrowed) :
+chunks{cut(s, borrowed)}, dirty{}, painted{} {
+  layout(0);
+}
+
+std::size_t ChunkList::at(std::size_t cx) const {
+  auto it = std::upper_bound(chunks.begin(), chunks.end(), cx,
+    [](std::size_t c, const Chunk& chunk) { return c < chunk.cx; });
+  return (it == chunks.begin()) ? 0 : it - chunks.begin() - 1;
+}
+
+std::size_t ChunkList::atRender(std::size_t rx) const {
+  auto it = std::upper_bound(chunks.begin(), chunks.end(), rx,
+    [](std::size_t r, const Chunk& chunk) { return r < chunk.rx; });
+  return (it == chunks.begin()) ? 0 : it - chunks.begin() - 1;
+}
+
+// Throws away painted highlighting, or all of it, so the next pass over
+// the row works it out again.
+void ChunkList::clearHighlight(bool all) {
+  auto first = all ? 0 : painted.first;
+  auto last = all ? chunks.size() : std::min(painted.last, chunks.size());
+  for (auto j = first; j < last; j++) {
+    if (all || !chunks[j].hl.empty()) {
+      chunks[j].hl.clear();
+      chunks[j].hl_in = HL_DIRTY;
+      dirty.add(j);
+    }
+  }
+  painted = ChunkRange();
+}
+
+std::size_t ChunkList::cxtorx(std::size_t cx) const {
+  const Chunk& chunk = chunks[at(cx)];
+  std::string_view text = chunk.chars;
+  auto local = std::min(cx - chunk.cx, text.length());
+  if (!chunk.tabs) {
+    return chunk.rx + local;
+  }
+
+  std::size_t rx = chunk.rx;
+  for (std::size_t j = 0; j < local; j++) {
+    rx = (text[j] == '\t') ? tabEnd(rx) : rx + 1;
+  }
+  return rx;
+}
+
+// A match that starts in one chunk and ends in the next is looked for in
+// the seam between them, so neither chunk has to be copied whole.
+std::size_t ChunkList::find(std::string_view needle, std::size_t from) const {
+  auto n = needle.empty() ? 0 : needle.length() - 1;
+  for (auto k = at(from); k < chunks.size(); k++) {
+    const Chunk& chunk = chunks[k];
+    std::size_t start = (from > chunk.cx) ? from - chunk.cx : 0;
+    auto found = findText(chunk.chars, needle, start);
+    if (found != std::string_view::npos) {
+      return chunk.cx + found;
+    }
+    if (n == 0 || k + 1 == chunks.size()) {
+      continue;
+    }
+
+    auto len = chunk.chars.length();
+    auto lead = std::min(n, len);
+    found = findText(seam(k, n), needle,
+      (start > len - lead) ? start - (len - lead) : 0);
+    if (found < lead) {
+      return chunk.cx + len - lead + found;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Splits a chunk that has grown past two KILO_CHUNKs and merges one that
+// has shrunk below a quarter of one into its neighbour.
+void ChunkList::fit(std::size_t j) {
+  auto len = chunks[j].chars.length();
+  if (len > 2 * KILO_CHUNK) {
+    auto pieces = cut(chunks[j].chars, chunks[j].chars.borrowed());
+    chunks.erase(chunks.begin() + j);
+    chunks.insert(chunks.begin() + j, std::make_move_iterator(pieces.begin()),
+      std::make_move_iterator(pieces.end()));
+  } else if (len < KILO_CHUNK / 4 && chunks.size() > 1) {
+    auto p = (j > 0) ? j - 1 : j;
+    chunks[p].chars.append(chunks[p + 1].chars);
+    chunks[p].stale = true;
+    chunks.erase(chunks.begin() + p + 1);
+    fit(p);
+  }
+}
+
+// Recomputes where each chunk from first on starts. Chunks whose text
+// changed, or whose tabs now start at a different phase, are expanded
+// again; the rest only have their offsets moved. A re-expanded chunk also
+// dirties the highlighting of the one before it, which looks ahead into it.
+// Chunks from first on may have moved, so which of them are dirty or hold
+// highlighting is worked out again on the way.
+void ChunkList::layout(std::size_t first) {
+  dirty.clip(first);
+  painted.clip(first);
+  for (auto j = first; j < chunks.size(); j++) {
+    Chunk& chunk = chunks[j];
+    std::size_t rx = 0;
+    chunk.cx = 0;
+    if (j > 0) {
+      chunk.cx = chunks[j - 1].cx + chunks[j - 1].chars.length();
+      rx = chunks[j - 1].rx + chunks[j - 1].width;
+    }
+
+    if (!chunk.stale &&
+    (!chunk.tabs || chunk.rx % KILO_TAB_STOP == rx % KILO_TAB_STOP)) {
+      chunk.rx = rx;
+    } else {
+      expand(chunk, rx);
+      if (j > 0) {
+        chunks[j - 1].hl_in = HL_DIRTY;
+        dirty.add(j - 1);
+      }
+    }
+    if (chunk.hl_in.in_comment == HL_DIRTY.in_comment) {
+      dirty.add(j);
+    }
+    if (!chunk.hl.empty()) {
+      painted.add(j);
+    }
+  }
+}
+
+std::size_t ChunkList::length() const {
+  return chunks.back().cx + chunks.back().chars.length();
+}
+
+void ChunkList::paint(std::size_t from, std::size_t to, HL kind) {
+  for (auto k = atRender(from); k < chunks.size() && chunks[k].rx < to; k++) {
+    Chunk& chunk = chunks[k];
+    auto first = std::max(from, chunk.rx) - chunk.rx;
+    auto last = std::min(to, chunk.rx + chunk.width) - chunk.rx;
+    if (first < last) {
+      chunk.hl.resize(chunk.width, HL{});
+      std::fill(chunk.hl.begin() + first, chunk.hl.begin() + last, kind);
+      painted.add(k);
+    }
+  }
+}
+
+std::size_t ChunkList::rfind(std::string_view needle,
+std::size_t before) const {
+  if (before == 0) {
+    return std::string_view::npos;
+  }
+
+  auto n = needle.empty() ? 0 : needle.length() - 1;
+  for (auto k = at(before - 1) + 1; k-- > 0; ) {
+    const Chunk& chunk = chunks[k];
+    auto limit = before - chunk.cx;
+    auto len = chunk.chars.length();
+    if (n > 0 && k + 1 < chunks.size()) {
+      auto lead = std::min(n, len);
+      auto skip = len - lead;
+      if (limit > skip) {
+        auto found = rfindText(seam(k, n), needle,
+          std::min(lead, limit - skip));
+        if (found != std::string_view::npos) {
+          return chunk.cx + skip + found;
+        }
+      }
+    }
+
+    auto found = rfindText(chunk.chars, needle, limit);
+    if (found != std::string_view::npos) {
+      return chunk.cx + found;
+    }
+  }
+  return std::string_view::npos;
+}
+
+std::size_t ChunkList::rxtocx(std::size_t rx) const {
+  const Chunk& chunk = chunks[atRender(rx)];
+  std::string_view text = chunk.chars;
+  if (!chunk.tabs) {
+    return chunk.cx + std::min(rx - chunk.rx, text.length());
+  }
+
+  std::size_t col = chunk.rx;
+  for (std::size_t j = 0; j < text.length(); j++) {
+    col = (text[j] == '\t') ? tabEnd(col) : col + 1;
+    if (rx < col) {
+      return chunk.cx + j;
+    }
+  }
+  return chunk.cx + text.length();
+}
+
+// The last n bytes of chunk k followed by the n bytes after it.
+std::string ChunkList::seam(std::size_t k, std::size_t n) const {
+  std::string_view text = chunks[k].chars;
+  std::string out(text.substr(text.length() - std::min(n, text.length())));
+  auto want = out.length() + n;
+  for (auto j = k + 1; j < chunks.size() && out.length() < want; j++) {
+    out.append(std::string_view(chunks[j].chars).substr(0,
+      want - out.length()));
+  }
+  return out;
+}
+
+// Replaces chars[pos, pos + removed) with s. Only the chunks the edit
+// touches are rewritten; those after it just have their offsets moved.
+void ChunkList::splice(std::size_t pos, std::size_t removed,
+std::string_view s) {
+  if (removed == 0 && s.empty()) {
+    return;
+  }
+
+  auto k = at(pos);
+  auto end = pos + removed;
+  auto m = k;
+  while (m + 1 < chunks.size() && chunks[m + 1].cx < end) {
+    m++;
+  }
+
+  Chunk& first = chunks[k];
+  auto offset = pos - first.cx;
+  if (m == k) {
+    first.chars.erase(offset, removed);
+  } else {
+    chunks[m].chars.erase(0, end - chunks[m].cx);
+    chunks[m].stale = true;
+    first.chars.erase(offset);
+    chunks.erase(chunks.begin() + k + 1, chunks.begin() + m);
+    m = k + 1;
+  }
+  first.chars.insert(offset, s);
+  first.stale = true;
+
+  if (m != k) {
+    fit(m);
+  }
+  fit(k);
+  layout((k > 0) ? k - 1 : 0);
+}
+
+std::string ChunkList::substr(std::size_t pos, std::size_t n) const {
+  std::string out;
+  auto size = length();
+  if (pos >= size) {
+    return out;
+  }
+  auto end = (n > size - pos) ? size : pos + n;
+  out.reserve(end - pos);
+  for (auto k = at(pos); k < chunks.size() && chunks[k].cx < end; k++) {
+    std::string_view text = chunks[k].chars;
+    auto first = (pos > chunks[k].cx) ? pos - chunks[k].cx : 0;
+    out.append(text.substr(first, end - chunks[k].cx - first));
+  }
+  return out;
+}
+
+std::size_t ChunkList::width() const {
+  return chunks.back().rx + chunks.back().width;
+}
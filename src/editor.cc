@@ -8,21 +8,48 @@
 #include <cstring>
 #include <ctime>
 #include <fstream>
+#include <thread>
+#include <utility>
 #include <unistd.h>
 #include "editor.h"
+#include "profile.h"
 #include "screen.h"
-
-namespace fs = std::filesystem;
+#include "search.h"
 
 constexpr const char* KILO_VERSION = "0.0.1";
 
 constexpr const int KILO_QUIT_TIMES = 3;
 
-#define CTRL_KEY(k) ((k) & 0x1f)
+constexpr const std::chrono::seconds KILO_MESSAGE_TIME{5};
 
-bool is_separator(int c) {
-  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
-}
+constexpr const std::chrono::milliseconds KILO_PROGRESS_TIME{100};
+
+constexpr const std::chrono::milliseconds KILO_LOAD_TIME{10};
+
+constexpr const std::chrono::milliseconds KILO_LOAD_SLICE{8};
+
+constexpr const std::chrono::microseconds KILO_FRAME_INTERVAL{1000000 / 60};
+
+constexpr const std::chrono::milliseconds KILO_FRAME_STALL{250};
+
+enum KiloTimer {
+  FRAME_TIMER,
+  MESSAGE_TIMER,
+  PROGRESS_TIMER
+};
+
+constexpr const std::size_t KILO_LOAD_BATCH = 4096;
+
+constexpr const std::size_t KILO_SCAN_MIN = std::size_t{1} << 16;
+
+constexpr const std::size_t KILO_MEMORY_LIMIT = std::size_t{1} << 30;
+
+constexpr const char* KILO_SEARCH_PROMPT =
+  "Search: %s (Use ESC/Arrows/Enter, ^R regex)";
+constexpr const char* KILO_REGEX_PROMPT =
+  "Regex: %s (Use ESC/Arrows/Enter, ^R literal)";
+
+#define CTRL_KEY(k) ((k) & 0x1f)
 
 FGColor syntaxToColor(HL hl) {
   switch (hl) {
@@ -33,25 +60,51 @@ FGColor syntaxToColor(HL hl) {
     case HL::STRING: return FGColor::MAGENTA;
     case HL::NUMBER: return FGColor::RED;
     case HL::MATCH: return FGColor::BLUE;
+    case HL::NORMAL: return FGColor::RESET;
     default: return FGColor::WHITE;
   }
 }
-Editor::Editor() : cx{0}, cy{0}, rx{0}, rowoff{0}, coloff{0},
-rows{}, dirty{false}, filename{}, statusmsg{0}, statusmsg_time{0},
-syntax{std::nullopt}, hldb {
-  {
-    "c",
-    { ".c", ".h", ".cc", ".cpp" },
-    {
-      "switch", "if", "while", "for", "break", "continue", "return", "else",
-      "struct", "union", "typedef", "static", "enum", "class", "case",
-      "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-      "void|"
-    },
-    "//", "/*", "*/",
-    HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
+
+Editor::Editor() : cx{0}, cy{0}, rx{0}, rowoff{0}, coloff{0}, file{},
+view{}, memory_limit{KILO_MEMORY_LIMIT}, rows{}, dirty{false}, filename{},
+statusmsg{0}, statusmsg_time{0}, syntax{std::nullopt}, hl_frontier{0},
+hl_scratch{}, hl_threads{std::max(1u, std::thread::hardware_concurrency())},
+painted_first{0}, painted_last{0}, hldb{}, find_regex{false},
+find_pattern{}, find_prompt{}, history{}, save{}, load{},
+perf_overlay{false}, timers{}, frame_interval{KILO_FRAME_INTERVAL},
+last_frame{} {
+}
+
+void Editor::applyUndo(const UndoOp& op, bool inverse) {
+  auto kind = op.kind;
+  if (inverse) {
+    switch (kind) {
+      case UndoKind::INSERT: kind = UndoKind::ERASE; break;
+      case UndoKind::ERASE: kind = UndoKind::INSERT; break;
+      case UndoKind::INSERT_ROW: kind = UndoKind::DELETE_ROW; break;
+      case UndoKind::DELETE_ROW: kind = UndoKind::INSERT_ROW; break;
+    }
   }
-} {
+
+  switch (kind) {
+    case UndoKind::INSERT:
+      rows[op.row].insert(op.col, history.text(op));
+      break;
+    case UndoKind::ERASE:
+      rows[op.row].erase(op.col, op.length);
+      break;
+    case UndoKind::INSERT_ROW: {
+      Row row(history.text(op));
+      row.update();
+      rows.insert(op.row, std::move(row));
+      break;
+    }
+    case UndoKind::DELETE_ROW:
+      rows.erase(op.row);
+      break;
+  }
+  invalidateSyntax(op.row);
+  dirty = true;
 }
 
 void Editor::delChar() {
@@ -62,18 +115,23 @@ void Editor::delChar() {
     return;
   }
 
+  history.open(cx, cy);
   Row& row = rows[cy];
   if (cx > 0) {
+    history.add(UndoKind::ERASE, cy, cx - 1, row.text(cx - 1, 1), true);
     row.erase(cx - 1);
-    updateSyntax(row);
+    invalidateSyntax(cy);
     cx--;
   } else {
-    cx = rows[cy - 1].chars.length();
-    rows[cy - 1].append(row.chars);
-    updateSyntax(rows[cy - 1]);
+    cx = rows[cy - 1].length();
+    auto text = row.text();
+    history.add(UndoKind::INSERT, cy - 1, cx, text);
+    rows[cy - 1].append(text);
     delRow(cy);
     cy--;
+    invalidateSyntax(cy);
   }
+  history.close(cx, cy);
   dirty = true;
 }
 
@@ -81,7 +139,11 @@ void Editor::delRow(std::size_t at) {
   if (at >= rows.size()) {
     return;
   }
-  rows.erase(rows.begin() + at);
+  history.open(cx, cy);
+  history.add(UndoKind::DELETE_ROW, at, 0, rows[at].text());
+  history.close(cx, cy);
+  rows.erase(at);
+  invalidateSyntax(at);
   dirty = true;
 }
 
@@ -91,12 +153,46 @@ void Editor::drawMessageBar(Screen& screen) {
   if (msglen > screen.cols) {
     msglen = screen.cols;
   }
-  if (msglen && time(NULL) - statusmsg_time < 5) {
+  if (msglen && time(NULL) - statusmsg_time < KILO_MESSAGE_TIME.count()) {
     screen.print(statusmsg, msglen);
   }
 }
 
+static void drawSpan(Screen& screen, std::string_view render,
+const Highlight& hl, std::size_t first, std::size_t last) {
+  last = std::min(render.length(), last);
+  auto hl_last = std::min(hl.length(), last);
+  for (auto j = first; j < last; ) {
+    auto kind = (j < hl_last) ? hl[j] : HL::NORMAL;
+    auto end = j + 1;
+    if (j < hl_last) {
+      while (end < hl_last && hl[end] == kind) {
+        end++;
+      }
+    } else {
+      end = last;
+    }
+    screen.printSpan(render.data() + j, end - j, syntaxToColor(kind));
+    j = end;
+  }
+}
+
 void Editor::drawRows(Screen& screen) {
+  // Only rows on screen keep their render and highlighting.
+  std::size_t bottom = std::min(rowoff + screen.rows, rows.size());
+  for (auto j = painted_first; j < std::min(painted_last, rows.size()); j++) {
+    if (j < rowoff || j >= bottom) {
+      rows[j].unpaint();
+    }
+  }
+  painted_first = rowoff;
+  painted_last = bottom;
+  auto it = rows.at(rowoff);
+  for (auto j = rowoff; j < bottom; ++it, ++j) {
+    it->expand();
+  }
+  updateSyntax(rowoff, rowoff + screen.rows, screen.cols);
+
   for (auto y = 0; y < screen.rows; y++) {
     std::size_t filerow = y + rowoff;
     if (filerow >= rows.size()) {
@@ -120,41 +216,20 @@ void Editor::drawRows(Screen& screen) {
         screen.printChar('~');
       }
     } else {
-      int len = rows[filerow].render.length() - coloff;
-      if (len < 0) {
-        len = 0;
-      }
-      if (len > screen.cols) {
-        len = screen.cols;
-      }
-      auto render = rows[filerow].render;
-      auto hl = rows[filerow].hl;
-      FGColor current_color = FGColor::RESET;
-      for (auto j = 0; j < len; j++) {
-        if (iscntrl(render[coloff + j])) {
-          char sym = (render[coloff + j] <= 26) ? '@' + render[coloff + j] : '?';
-          screen.inverse();
-          screen.printChar(sym);
-          screen.inverse(false);
-          if (current_color != FGColor::RESET) {
-            screen.setFGColor(current_color);
-          }
-        } else if (hl[coloff + j] == HL::NORMAL) {
-          if (current_color != FGColor::RESET) {
-            screen.setFGColor(FGColor::RESET);
-            current_color = FGColor::RESET;
-          }
-          screen.printChar(render[coloff + j]);
-        } else {
-          FGColor color = syntaxToColor(hl[coloff + j]);
-          if (color != current_color) {
-            current_color = color;
-            screen.setFGColor(color);
-          }
-          screen.printChar(render[coloff + j]);
+      const Row& row = std::as_const(rows)[filerow];
+      std::size_t last = coloff + screen.cols;
+      if (!row.chunks()) {
+        drawSpan(screen, row.rendered(), row.highlight(), coloff, last);
+      } else {
+        auto& chunks = row.chunks()->chunks;
+        for (auto k = row.chunks()->atRender(coloff);
+        k < chunks.size() && chunks[k].rx < last; k++) {
+          auto& chunk = chunks[k];
+          auto first = std::max(coloff, chunk.rx) - chunk.rx;
+          drawSpan(screen, chunk.rendered(), chunk.hl, first,
+            last - chunk.rx);
         }
       }
-      screen.setFGColor(FGColor::RESET);
     }
 
     screen.clearToEOL();
@@ -164,12 +239,36 @@ void Editor::drawRows(Screen& screen) {
 
 void Editor::drawStatusBar(Screen& screen) {
   screen.inverse();
-  char status[80], rstatus[80];
-  int len = snprintf(status, sizeof(status), "%.20s - %ld lines %s",
-    filename.empty() ? "[No Name]" : filename.c_str(), rows.size(),
-    dirty ? "(modified)" : "");
-  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %ld/%ld",
-    syntax ? syntax->filetype.c_str() : "no ft", cy + 1, rows.size());
+  if (perf_overlay) {
+    std::string text = profile.overlay();
+    int len = std::min<int>(text.length(), screen.cols);
+    screen.print(text.data(), len);
+    for (; len < screen.cols; len++) {
+      screen.printChar(' ');
+    }
+    screen.inverse(false);
+    screen.print("\r\n", 2);
+    return;
+  }
+
+  char status[80], rstatus[80], note[32];
+  std::size_t base = view ? view->first : 0;
+  std::size_t total = view ? view->lines() : rows.size();
+  const char* more = (load || (view && !view->indexed())) ? "+" : "";
+  if (load) {
+    snprintf(note, sizeof(note), "(loading %d%%)%s", load->progress(),
+      dirty ? " (modified)" : "");
+  } else {
+    snprintf(note, sizeof(note), "%s",
+      view ? "(read-only)" : dirty ? "(modified)" : "");
+  }
+  int len = snprintf(status, sizeof(status), "%.20s - %ld%s lines %s",
+    filename.empty() ? "[No Name]" : filename.c_str(), total, more, note);
+  std::size_t offset = (view ? view->lineOffset(base + cy) :
+    rows.lineOffset(cy)) + cx;
+  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %ld/%ld%s | byte %ld",
+    syntax ? syntax->filetype.c_str() : "no ft", base + cy + 1, total, more,
+    offset);
   if (len > screen.cols) {
     len = screen.cols;
   }
@@ -188,6 +287,7 @@ void Editor::drawStatusBar(Screen& screen) {
 }
 
 void Editor::draw(Screen& screen) {
+  PROFILE(Phase::RENDER);
   scroll(screen);
 
   screen.hideCursor();
@@ -203,115 +303,407 @@ void Editor::draw(Screen& screen) {
   screen.refresh();
 }
 
+// Draws a frame unless more keys are already waiting or the last frame
+// went out less than frame_interval ago. A frame held back for the rate
+// is drawn when a timer fires, so the screen always catches up with the
+// last key. Input that never lets up still gets a frame every
+// KILO_FRAME_STALL.
+void Editor::drawFrame(Screen& screen) {
+  auto now = TimerWheel::Clock::now();
+  if (now - last_frame < KILO_FRAME_STALL && screen.inputPending()) {
+    return;
+  }
+  if (now - last_frame < frame_interval) {
+    timers.schedule(FRAME_TIMER, last_frame + frame_interval - now, [] {});
+    return;
+  }
+
+  timers.cancel(FRAME_TIMER);
+  last_frame = now;
+  draw(screen);
+}
+
 void Editor::find(Screen& screen) {
+  std::size_t base = view ? view->first : 0;
   int saved_cx = cx;
-  int saved_cy = cy;
+  std::size_t saved_cy = base + cy;
   int saved_coloff = coloff;
-  int saved_rowoff = rowoff;
+  std::size_t saved_rowoff = base + rowoff;
 
-  std::string query = prompt(screen, "Search: %s (Use ESC/Arrows/Enter)",
+  find_prompt = find_regex ? KILO_REGEX_PROMPT : KILO_SEARCH_PROMPT;
+  std::string query = prompt(screen, find_prompt,
     std::make_optional(&Editor::findCallback));
 
   if (query.empty()) {
+    if (view && view->first != base) {
+      loadView(saved_cy);
+    }
+    base = view ? view->first : 0;
     cx = saved_cx;
-    cy = saved_cy;
+    cy = saved_cy - base;
     coloff = saved_coloff;
-    rowoff = saved_rowoff;
+    rowoff = (saved_rowoff > base) ? saved_rowoff - base : 0;
   }
 }
 
 void Editor::findCallback(std::string& query, int key) {
-  static std::optional<std::size_t> last_match = std::nullopt;
-  static int direction = 1;
-
-  static int saved_hl_line;
+  static std::optional<std::size_t> saved_hl_line = std::nullopt;
   static Highlight saved_hl;
 
-  if (!saved_hl.empty()) {
-    rows[saved_hl_line].hl = saved_hl;
-    saved_hl.clear();
+  if (saved_hl_line) {
+    if (*saved_hl_line < rows.size()) {
+      Row& row = rows[*saved_hl_line];
+      if (row.chunks()) {
+        row.chunks()->clearHighlight();
+      } else if (saved_hl.empty()) {
+        row.unpaint();
+      } else {
+        row.paint() = saved_hl;
+      }
+    }
+    saved_hl_line = std::nullopt;
   }
 
-  if (key == '\r' || key == '\x1b') {
-    last_match = std::nullopt;
-    direction = 1;
+  if (key == CTRL_KEY('r')) {
+    find_regex = !find_regex;
+  }
+  find_prompt = find_regex ? KILO_REGEX_PROMPT : KILO_SEARCH_PROMPT;
+
+  if (key == '\r' || key == '\x1b' || query.empty() || rows.size() == 0) {
     return;
-  } else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
-    direction = 1;
+  }
+
+  static std::string compiled;
+  if (find_regex && (query != compiled || key == CTRL_KEY('r'))) {
+    compiled = query;
+    if (!find_pattern.compile(query)) {
+      compiled.clear();
+      find_prompt = "Regex (" + find_pattern.error + "): %s";
+      return;
+    }
+  }
+
+  std::size_t length = query.length();
+  auto next = [&](std::string_view text, std::size_t from) {
+    return find_regex ? find_pattern.find(text, from, length) :
+      findText(text, query, from);
+  };
+  auto prev = [&](std::string_view text, std::size_t before) {
+    return find_regex ? find_pattern.rfind(text, before, length) :
+      rfindText(text, query, before);
+  };
+
+  // Literal searches of a long row go chunk by chunk. A regex can match
+  // across any number of chunks, so it is given the row joined up.
+  auto search = [&](const Row& row, std::size_t at, int direction) {
+    if (!row.chunks()) {
+      return (direction == 1) ? next(row.chars, at) : prev(row.chars, at);
+    }
+    if (find_regex) {
+      auto text = row.text();
+      return (direction == 1) ? next(text, at) : prev(text, at);
+    }
+    return (direction == 1) ? row.chunks()->find(query, at) :
+      row.chunks()->rfind(query, at);
+  };
+
+  int direction = 1;
+  std::size_t current = (cy < rows.size()) ? cy : 0;
+  std::size_t col = (cy < rows.size()) ? cx : 0;
+  if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+    col++;
   } else if (key == ARROW_LEFT || key == ARROW_UP) {
     direction = -1;
+  }
+
+  // A file too large to load is searched on disk a block at a time. A
+  // regex goes line by line within each block so its anchors still work.
+  auto lines = [&](std::string_view text, std::size_t at) {
+    auto line = [&](std::size_t start) {
+      auto end = text.find('\n', start);
+      auto s = text.substr(start, end - start);
+      while (!s.empty() && s.back() == '\r') {
+        s.remove_suffix(1);
+      }
+      return s;
+    };
+
+    at = std::min(at, text.length() + 1);
+    if (direction == 1) {
+      auto start = (at == 0) ? 0 : text.rfind('\n', at - 1) + 1;
+      while (start < text.length()) {
+        auto hit = next(line(start), (at > start) ? at - start : 0);
+        if (hit != std::string_view::npos) {
+          return start + hit;
+        }
+        start = text.find('\n', start);
+        if (start == std::string_view::npos) {
+          break;
+        }
+        start++;
+      }
+      return std::string_view::npos;
+    }
+    if (at == 0) {
+      return std::string_view::npos;
+    }
+    for (std::size_t start = (at < 2) ? 0 : text.rfind('\n', at - 2) + 1; ; ) {
+      auto hit = prev(line(start), at - start);
+      if (hit != std::string_view::npos) {
+        return start + hit;
+      }
+      if (start == 0) {
+        return std::string_view::npos;
+      }
+      start = (start < 2) ? 0 : text.rfind('\n', start - 2) + 1;
+    }
+  };
+
+  auto match = std::string_view::npos;
+  if (view) {
+    auto start = view->lineOffset(view->first + current);
+    auto hit = view->find(start, start + col, direction == 1, query.length(),
+      [&](std::string_view text, std::size_t at) {
+        if (find_regex) {
+          return lines(text, at);
+        }
+        return (direction == 1) ? findText(text, query, at) :
+          rfindText(text, query, at);
+      });
+    if (hit == std::string_view::npos) {
+      return;
+    }
+    auto line = view->lineAt(hit);
+    match = hit - view->lineOffset(line);
+    loadView(line);
+    current = line - view->first;
+    std::size_t rowlen = rows[current].length();
+    match = std::min(match, rowlen);
+    length = std::min(length, rowlen - match);
+  } else if (direction == 1) {
+    auto it = rows.at(current);
+    for (std::size_t i = 0; i <= rows.size(); i++) {
+      match = search(*it, (i == 0) ? col : 0, direction);
+      if (match != std::string_view::npos) {
+        break;
+      }
+      current++;
+      if (++it == rows.end()) {
+        it = rows.begin();
+        current = 0;
+      }
+    }
   } else {
-    last_match = std::nullopt;
-    direction = 1;
-  }
-
-  if (last_match == std::nullopt) {
-    direction = 1;
-  }
-  std::optional<std::size_t> current = last_match;
-  for (std::size_t i = 0; i < rows.size(); i++) {
-    *current += direction;
-    if (current == std::nullopt) {
-      current = rows.size() - 1;
-    } else if (*current == rows.size()) {
-      current = 0;
-    }
-
-    Row& row = rows[*current];
-    auto match = row.render.find(query);
-    if (match != std::string::npos) {
-      last_match = *current;
-      cy = *current;
-      cx = row.rxtocx(match);
-      rowoff = rows.size();
-
-      saved_hl_line = *current;
-      saved_hl = row.hl;
-      std::fill(row.hl.begin() + match,
-        row.hl.begin() + match + query.length(), HL::MATCH);
-      break;
+    for (std::size_t i = 0; i <= rows.size(); i++) {
+      const Row& row = std::as_const(rows)[current];
+      match = search(row, (i == 0) ? col : row.length() + 1, direction);
+      if (match != std::string_view::npos) {
+        break;
+      }
+      current = (current == 0) ? rows.size() - 1 : current - 1;
+    }
+  }
+  if (match == std::string_view::npos) {
+    return;
+  }
+
+  cy = current;
+  cx = match;
+  rowoff = rows.size();
+
+  updateSyntax(current, current + 1, 0);
+  Row& row = rows[current];
+  saved_hl_line = current;
+  if (row.chunks()) {
+    std::size_t first = row.cxtorx(match);
+    std::size_t last = row.cxtorx(match + length);
+    if (syntax) {
+      highlightChunks(*row.chunks(), row.hl_start, first, last);
     }
+    row.chunks()->paint(first, last, HL::MATCH);
+    return;
+  }
+  saved_hl = row.highlight();
+  Highlight& hl = row.paint();
+  hl.resize(row.rendered().length(), HL::NORMAL);
+  std::fill(hl.begin() + row.cxtorx(match),
+    hl.begin() + row.cxtorx(match + length), HL::MATCH);
+}
+
+// Asks for a line number and moves to the start of that line.
+void Editor::gotoLine(Screen& screen) {
+  std::string input = prompt(screen, "Go to line: %s (ESC to cancel)",
+    std::nullopt);
+  if (input.empty()) {
+    return;
+  }
+
+  char* end;
+  std::size_t line = strtoull(input.c_str(), &end, 10);
+  if (*end != '\0' || line == 0) {
+    setStatusMessage("Not a line number: %s", input.c_str());
+    return;
   }
+  jumpTo(screen, line - 1, 0);
+}
+
+// Asks for a byte offset into the file and moves to the character there.
+void Editor::gotoOffset(Screen& screen) {
+  std::string input = prompt(screen, "Go to byte: %s (ESC to cancel)",
+    std::nullopt);
+  if (input.empty()) {
+    return;
+  }
+
+  char* end;
+  std::size_t offset = strtoull(input.c_str(), &end, 10);
+  if (*end != '\0') {
+    setStatusMessage("Not a byte offset: %s", input.c_str());
+    return;
+  }
+
+  std::size_t line;
+  if (view) {
+    offset = std::min(offset, view->size);
+    line = view->lineAt(offset);
+    jumpTo(screen, line, offset - view->lineOffset(line));
+    return;
+  }
+  if (load && offset >= rows.lineOffset(rows.size())) {
+    finishLoad();
+  }
+  line = rows.lineAt(offset);
+  jumpTo(screen, line, offset - std::min(offset, rows.lineOffset(line)));
+}
+
+// Moves the cursor to col on line, or as near as the file allows, and
+// scrolls so the line is in the middle of the screen.
+void Editor::jumpTo(Screen& screen, std::size_t line, std::size_t col) {
+  if (view) {
+    if (view->indexed()) {
+      line = std::min(line, view->lines());
+    }
+    loadView(line);
+    line -= std::min(line, view->first);
+  } else if (load && line >= rows.size()) {
+    finishLoad();
+  }
+
+  if (line >= rows.size()) {
+    line = rows.size() ? rows.size() - 1 : 0;
+    col = std::string::npos;
+  }
+  cy = line;
+  cx = (cy < rows.size()) ? std::min(col, rows[cy].length()) : 0;
+  rowoff = cy - std::min<std::size_t>(cy, screen.rows / 2);
+}
+
+// Pages the read-only view so that line is in the middle of the window.
+void Editor::loadView(std::size_t line) {
+  view->load(rows, line - std::min(line, view->window / 2));
+  hl_frontier = 0;
+}
+
+void Editor::invalidateSyntax(std::size_t at) {
+  if (at < rows.size()) {
+    rows[at].hl_start = -1;
+  }
+  hl_frontier = std::min(hl_frontier, at);
 }
 
 void Editor::insertChar(int c) {
+  history.open(cx, cy);
   if (cy == rows.size()) {
     insertRow(rows.size(), "");
   }
+  char ch = c;
+  history.add(UndoKind::INSERT, cy, cx, std::string_view(&ch, 1), true);
   rows[cy].insert(cx, c);
-  updateSyntax(rows[cy]);
+  invalidateSyntax(cy);
   dirty = true;
   cx++;
+  history.close(cx, cy);
 }
 
 void Editor::insertNewline() {
+  history.open(cx, cy);
   if (cx == 0) {
     insertRow(cy, "");
   } else {
-    auto copy = rows[cy].chars.substr(cx);
-    insertRow(cy + 1, copy.c_str());
-    updateSyntax(rows[cy + 1]);
-    rows[cy].chars.erase(cx);
-    rows[cy].update();
-    updateSyntax(rows[cy]);
+    auto tail = rows[cy].text(cx);
+    insertRow(cy + 1, tail);
+    history.add(UndoKind::ERASE, cy, cx, tail);
+    rows[cy].erase(cx, std::string::npos);
+    invalidateSyntax(cy);
   }
   cy++;
   cx = 0;
+  history.close(cx, cy);
 }
 
-void Editor::insertRow(std::size_t at, const char* s) {
+void Editor::insertRow(std::size_t at, std::string_view s) {
   if (at > rows.size()) {
     return;
   }
 
-  rows.emplace(rows.begin() + at, at, s);
-  for (auto j = at + 1; j < rows.size(); j++) {
-    rows[j].idx++;
+  history.open(cx, cy);
+  history.add(UndoKind::INSERT_ROW, at, 0, s);
+  history.close(cx, cy);
+
+  Row row(s);
+  row.update();
+  rows.insert(at, std::move(row));
+  invalidateSyntax(at);
+
+  dirty = true;
+}
+
+void Editor::insertText(std::string_view text) {
+  if (text.empty()) {
+    return;
+  }
+  history.open(cx, cy);
+  if (cy == rows.size()) {
+    insertRow(rows.size(), "");
   }
 
-  rows[at].update();
+  auto eol = text.find_first_of("\r\n");
+  if (eol == std::string_view::npos) {
+    history.add(UndoKind::INSERT, cy, cx, text);
+    rows[cy].insert(cx, text);
+    invalidateSyntax(cy);
+    cx += text.length();
+    dirty = true;
+    history.close(cx, cy);
+    return;
+  }
+
+  std::string tail(rows[cy].text(cx));
+  history.add(UndoKind::ERASE, cy, cx, tail);
+  rows[cy].erase(cx, std::string::npos);
+  history.add(UndoKind::INSERT, cy, cx, text.substr(0, eol));
+  rows[cy].insert(cx, text.substr(0, eol));
+  invalidateSyntax(cy);
+
+  while (eol != std::string_view::npos) {
+    auto next = eol + 1;
+    if (text[eol] == '\r' && next < text.length() && text[next] == '\n') {
+      next++;
+    }
+    text.remove_prefix(next);
+    eol = text.find_first_of("\r\n");
 
+    Row row(text.substr(0, eol));
+    row.update();
+    history.add(UndoKind::INSERT_ROW, cy + 1, 0, text.substr(0, eol));
+    rows.insert(++cy, std::move(row));
+  }
+
+  cx = rows[cy].length();
+  history.add(UndoKind::INSERT, cy, cx, tail);
+  rows[cy].append(tail);
   dirty = true;
+  history.close(cx, cy);
 }
 
 void Editor::moveCursor(int key) {
@@ -325,13 +717,13 @@ void Editor::moveCursor(int key) {
         cx--;
       } else if (cy > 0) {
         cy--;
-        cx = rows[cy].chars.length();
+        cx = rows[cy].length();
       }
       break;
     case ARROW_RIGHT:
-      if (row && cx < row->get().chars.length()) {
+      if (row && cx < row->get().length()) {
         cx++;
-      } else if (row && cx == row->get().chars.length()) {
+      } else if (row && cx == row->get().length()) {
         cy++;
         cx = 0;
       }
@@ -351,7 +743,7 @@ void Editor::moveCursor(int key) {
   row = (cy >= rows.size())
     ? std::nullopt
     : std::make_optional(std::ref(rows[cy]));
-  std::size_t rowlen = row ? row->get().chars.length() : 0;
+  std::size_t rowlen = row ? row->get().length() : 0;
   if (cx > rowlen) {
     cx = rowlen;
   }
@@ -362,32 +754,130 @@ void Editor::openFile(Screen& screen, const char *fn) {
 
   selectSyntaxHighlight();
 
-  FILE *fp = fopen(fn, "r");
-  if (!fp) {
-    screen.die("fopen");
+  std::error_code ec;
+  if (std::filesystem::file_size(fn, ec) > memory_limit && !ec) {
+    view = std::make_unique<FileView>();
+    if (!view->open(fn, memory_limit)) {
+      screen.die("open");
+    }
+    loadView(0);
+    dirty = false;
+    return;
   }
 
-  char *line = NULL;
-  size_t linecap = 0;
-  ssize_t linelen;
-  while ((linelen = getline(&line, &linecap, fp)) != -1) {
-    while (linelen > 0 && (line[linelen - 1] == '\n' ||
-                           line[linelen - 1] == '\r')) {
-      linelen--;
+  if (!file.open(fn)) {
+    screen.die("open");
+  }
+
+  // The first batch is enough for the first screen. The rest is read on
+  // a worker and appended as the event loop gets to it.
+  std::vector<LineSpan> lines;
+  std::size_t pos = scanLines(file.data, file.size, 0, lines,
+    KILO_LOAD_BATCH);
+  for (auto& line: lines) {
+    Row row(std::string_view(file.data + line.offset, line.length), true);
+    if (line.tabs) {
+      row.update();
     }
-    insertRow(rows.size(), line);
-    rows[rows.size() - 1].erase(linelen);
-    updateSyntax(rows[rows.size() - 1]);
+    rows.insert(rows.size(), std::move(row));
+  }
+  if (pos < file.size) {
+    load = std::make_unique<LoadJob>(file.data, file.size, pos);
   }
-  free(line);
-  fclose(fp);
   dirty = false;
 }
 
+// Waits for the rest of the file, for things that need all of it.
+void Editor::finishLoad() {
+  if (!load) {
+    return;
+  }
+  load->wait();
+  while (load->drain(rows, KILO_LOAD_SLICE)) {
+  }
+  load.reset();
+}
+
+void Editor::pollLoad() {
+  if (!load) {
+    return;
+  }
+  load->drain(rows, KILO_LOAD_SLICE);
+  if (load->done()) {
+    load.reset();
+  }
+}
+
+void Editor::pollSave() {
+  if (!save) {
+    return;
+  }
+
+  if (!save->done()) {
+    setStatusMessage("Saving... %d%%", save->progress());
+    return;
+  }
+
+  if (save->error.empty()) {
+    setStatusMessage("%ld bytes written to disk", save->bytes_written.load());
+  } else {
+    setStatusMessage("Can't save! %s", save->error.c_str());
+    dirty = true;
+  }
+  save.reset();
+}
+
+// Keys that leave the text alone.
+static bool readOnlyKey(int c) {
+  switch (c) {
+    case CTRL_KEY('q'):
+    case CTRL_KEY('f'):
+    case CTRL_KEY('g'):
+    case CTRL_KEY('b'):
+    case CTRL_KEY('o'):
+    case CTRL_KEY('p'):
+    case CTRL_KEY('l'):
+    case '\x1b':
+    case HOME_KEY:
+    case END_KEY:
+    case PAGE_UP:
+    case PAGE_DOWN:
+    case ARROW_UP:
+    case ARROW_DOWN:
+    case ARROW_LEFT:
+    case ARROW_RIGHT:
+      return true;
+  }
+  return false;
+}
+
 bool Editor::processKeypress(Screen& screen) {
   static int quit_times = KILO_QUIT_TIMES;
 
-  int c = screen.readKey();
+  if (load) {
+    timers.schedule(PROGRESS_TIMER, load->pending() ?
+      TimerWheel::Clock::duration::zero() : KILO_LOAD_TIME, [] {});
+  } else if (save || (view && !view->indexed())) {
+    timers.schedule(PROGRESS_TIMER, KILO_PROGRESS_TIME, [] {});
+  }
+  int c = screen.readKey(timers.next());
+  timers.expire();
+  pollSave();
+  pollLoad();
+  if (c == TIMEOUT || c == RESIZE) {
+    return true;
+  }
+
+  PROFILE(Phase::EDIT);
+  if (view && !readOnlyKey(c)) {
+    setStatusMessage("Read-only: file is larger than the memory limit");
+    return true;
+  }
+  if (load && cy >= rows.size() && !readOnlyKey(c) && c != CTRL_KEY('s') &&
+  c != CTRL_KEY('z') && c != CTRL_KEY('y')) {
+    setStatusMessage("Still loading: can't edit past line %ld", rows.size());
+    return true;
+  }
 
   switch (c) {
     case '\r':
@@ -416,7 +906,7 @@ bool Editor::processKeypress(Screen& screen) {
 
     case END_KEY:
       if (cy < rows.size()) {
-        cx = rows[cy].chars.length();
+        cx = rows[cy].length();
       }
       break;
 
@@ -424,6 +914,34 @@ bool Editor::processKeypress(Screen& screen) {
       find(screen);
       break;
 
+    case CTRL_KEY('g'):
+      gotoLine(screen);
+      break;
+
+    case CTRL_KEY('b'):
+      gotoOffset(screen);
+      break;
+
+    case CTRL_KEY('o'):
+      writeProfile(screen);
+      break;
+
+    case CTRL_KEY('p'):
+      toggleProfile();
+      break;
+
+    case CTRL_KEY('z'):
+      undo();
+      break;
+
+    case CTRL_KEY('y'):
+      redo();
+      break;
+
+    case PASTE:
+      insertText(screen.paste);
+      break;
+
     case BACKSPACE:
     case CTRL_KEY('h'):
     case DEL_KEY:
@@ -472,16 +990,23 @@ bool Editor::processKeypress(Screen& screen) {
   return true;
 }
 
-std::string Editor::prompt(Screen& screen, const char* msg,
+std::string Editor::prompt(Screen& screen, const std::string& msg,
 std::optional<std::function<void(Editor*, std::string&, int)>> callback) {
   std::string buf;
 
   while (true) {
-    setStatusMessage(msg, buf.c_str());
-    draw(screen);
+    setStatusMessage(msg.c_str(), buf.c_str());
+    drawFrame(screen);
 
-    int c = screen.readKey();
+    int c = screen.readKey(timers.next());
+    timers.expire();
+    if (c == TIMEOUT || c == RESIZE) {
+      continue;
+    }
     if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
+      if (!buf.empty()) {
+        buf.pop_back();
+      }
     }
     else if (c == '\x1b') {
       setStatusMessage("");
@@ -497,6 +1022,12 @@ std::optional<std::function<void(Editor*, std::string&, int)>> callback) {
         }
         return buf;
       }
+    } else if (c == PASTE) {
+      for (auto ch: screen.paste) {
+        if (!iscntrl(ch) && static_cast<unsigned char>(ch) < 128) {
+          buf += ch;
+        }
+      }
     } else if (!iscntrl(c) && c < 128) {
       buf += c;
     }
@@ -507,7 +1038,27 @@ std::optional<std::function<void(Editor*, std::string&, int)>> callback) {
   }
 }
 
+void Editor::redo() {
+  if (history.current == history.groups.size()) {
+    setStatusMessage("Nothing to redo");
+    return;
+  }
+
+  auto group = history.current++;
+  for (auto j = history.groups[group].first; j < history.last(group); j++) {
+    applyUndo(history.ops[j], false);
+  }
+  cx = history.groups[group].cx_after;
+  cy = history.groups[group].cy_after;
+  history.sealed = true;
+}
+
 void Editor::saveFile(Screen& screen) {
+  if (save) {
+    setStatusMessage("Save already in progress");
+    return;
+  }
+
   if (filename.empty()) {
     filename = prompt(screen, "Save as: %s (ESC to cancel)", std::nullopt);
     if (filename.empty()) {
@@ -517,28 +1068,26 @@ void Editor::saveFile(Screen& screen) {
     selectSyntaxHighlight();
   }
 
-  std::string buf;
-
-  for (auto& row: rows) {
-    buf += row.chars + '\n';
-  }
-
-  try {
-    std::ofstream file(filename.native());
-    file.exceptions(std::ofstream::failbit);
-    fs::permissions(filename, fs::perms::owner_read | fs::perms::owner_write |
-      fs::perms::group_read | fs::perms::others_read);
-    fs::resize_file(filename, buf.length());
-    file.write(buf.data(), buf.length());
-    dirty = false;
-    setStatusMessage("%ld bytes written to disk", buf.length());
-  } catch (std::system_error& e) {
-    setStatusMessage("Can't save! %s", e.what());
-    filename.clear();
-  }
+  finishLoad();
+  save = std::make_unique<SaveJob>(rows, filename);
+  dirty = false;
+  pollSave();
 }
 
 void Editor::scroll(Screen& screen) {
+  if (view) {
+    view->window = std::max(view->window, 8 * std::size_t(screen.rows));
+    std::size_t margin = view->window / 4;
+    if ((cy < margin && view->first > 0) ||
+    (cy + margin > rows.size() && !view->eof)) {
+      std::size_t line = view->first + cy;
+      std::size_t top = view->first + rowoff;
+      loadView(line);
+      cy = line - view->first;
+      rowoff = (top > view->first) ? top - view->first : 0;
+    }
+  }
+
   rx = 0;
 
   if (cy < rows.size()) {
@@ -561,28 +1110,96 @@ void Editor::scroll(Screen& screen) {
 
 void Editor::selectSyntaxHighlight() {
   syntax = std::nullopt;
+  hl_frontier = 0;
+  for (auto& row: rows) {
+    row.hl_start = -1;
+    row.unpaint();
+    if (row.chunks()) {
+      row.chunks()->clearHighlight(true);
+    }
+  }
 
   if (filename.empty()) {
     return;
   }
 
-  auto ext = filename.extension();
-  auto fn = filename.filename().native();
+  if (auto found = hldb.find(filename)) {
+    syntax = *found;
+  }
+}
 
-  for (auto& hl: hldb) {
-    for (auto& match: hl.filematch) {
-      auto is_ext = (match[0] == '.');
-      if ((is_ext && ext != fn && ext == match) ||
-      (!is_ext && fn.find(match) != std::string::npos)) {
-        syntax = hl;
+// Brings the comment state of rows [first, last) up to date on hl_threads
+// threads without keeping any highlighting. Each thread takes a slice and
+// runs it twice, once starting outside a comment and once inside one; the
+// second run stops as soon as the two agree after a row, since from there
+// on they are the same. Which run holds for a slice is then settled in
+// order from the row before first, and only that pass touches the tree.
+void Editor::scanSyntax(std::size_t first, std::size_t last) {
+  struct Slice {
+    Slice(std::size_t from, std::size_t to) : first{from}, last{to},
+    outside{}, inside{} {
+    }
 
-        for (std::size_t filerow = 0; filerow < rows.size(); filerow++) {
-          updateSyntax(rows[filerow]);
-        }
+    std::size_t first, last;
+    std::vector<signed char> outside;
+    std::vector<signed char> inside;
+  };
 
-        return;
+  const RowTree& tree = rows;
+  auto state = [this](const Row& row, int in_comment, Highlight& hl) {
+    if (row.hl_start == in_comment) {
+      return int{row.hl_open_comment};
+    }
+    return row.chunks() ? highlightRow(row.text(), in_comment, hl) :
+      highlightRow(row.rendered(), in_comment, hl);
+  };
+  auto run = [&tree, &state](Slice& slice) {
+    Highlight hl;
+    slice.outside.reserve(slice.last - slice.first);
+    int outside = 0, inside = 1;
+    bool apart = true;
+    auto it = tree.at(slice.first);
+    for (auto at = slice.first; at < slice.last; ++it, ++at) {
+      outside = state(*it, outside, hl);
+      slice.outside.push_back(outside);
+      if (apart) {
+        inside = state(*it, inside, hl);
+        slice.inside.push_back(inside);
+        apart = (inside != outside);
       }
     }
+  };
+
+  std::size_t count = std::min<std::size_t>(hl_threads,
+    (last - first + KILO_SCAN_MIN - 1) / KILO_SCAN_MIN);
+  std::size_t size = (last - first + count - 1) / count;
+  std::vector<Slice> slices;
+  for (auto at = first; at < last; at += size) {
+    slices.emplace_back(at, std::min(last, at + size));
+  }
+  std::vector<std::thread> threads;
+  for (std::size_t k = 1; k < slices.size(); k++) {
+    threads.emplace_back(run, std::ref(slices[k]));
+  }
+  run(slices[0]);
+  for (auto& thread: threads) {
+    thread.join();
+  }
+
+  int in_comment = (first > 0) ? rows[first - 1].hl_open_comment : 0;
+  auto it = rows.at(first);
+  for (auto& slice: slices) {
+    auto& taken = in_comment ? slice.inside : slice.outside;
+    for (std::size_t j = 0; j < slice.outside.size(); ++it, j++) {
+      int out = (j < taken.size()) ? taken[j] : slice.outside[j];
+      Row& row = *it;
+      if (row.hl_start != in_comment) {
+        row.hl_start = in_comment;
+        row.hl_open_comment = out;
+        row.unpaint();
+      }
+      in_comment = out;
+    }
   }
 }
 
@@ -592,127 +1209,183 @@ void Editor::setStatusMessage(const char *fmt, ...) {
   vsnprintf(statusmsg, sizeof(statusmsg), fmt, ap);
   va_end(ap);
   statusmsg_time = time(NULL);
+  timers.schedule(MESSAGE_TIMER, KILO_MESSAGE_TIME, [this] {
+    statusmsg[0] = '\0';
+  });
 }
 
-void Editor::updateSyntax(Row& row) {
-  row.hl.resize(row.render.length());
-  std::fill(row.hl.begin(), row.hl.end(), HL::NORMAL);
+// Turns on profiling and shows its overlay in place of the status bar, or
+// turns both off. What has been collected is kept until written out.
+void Editor::toggleProfile() {
+#ifdef KILO_PROFILE
+  perf_overlay = !perf_overlay;
+  profile.enabled.store(perf_overlay, std::memory_order_relaxed);
+  setStatusMessage(perf_overlay ? "Profiling on" : "Profiling off");
+#else
+  setStatusMessage("Profiling was not compiled in");
+#endif
+}
+
+void Editor::undo() {
+  if (history.current == 0) {
+    setStatusMessage("Nothing to undo");
+    return;
+  }
+
+  auto group = --history.current;
+  for (auto j = history.last(group); j-- > history.groups[group].first; ) {
+    applyUndo(history.ops[j], true);
+  }
+  cx = history.groups[group].cx_before;
+  cy = history.groups[group].cy_before;
+  history.sealed = true;
+}
 
+// Rows in [first, last) are on screen. A long row there only keeps
+// highlighting for the chunks under the cols columns from coloff.
+void Editor::updateSyntax(std::size_t first, std::size_t last,
+std::size_t cols) {
+  PROFILE(Phase::HIGHLIGHT);
   if (syntax == std::nullopt) {
     return;
   }
+  last = std::min(last, rows.size());
 
-  auto& scs = syntax->singleline_comment_start;
-  auto& mcs = syntax->multiline_comment_start;
-  auto& mce = syntax->multiline_comment_end;
+  std::size_t at = std::min(first, hl_frontier);
+  if (hl_threads > 1 && first >= at + KILO_SCAN_MIN) {
+    scanSyntax(at, first);
+    at = first;
+  }
+  int in_comment = (at > 0) ? rows[at - 1].hl_open_comment : 0;
+  for (auto it = rows.at(at); at < last; ++it, ++at) {
+    Row& row = *it;
+    bool visible = (at >= first);
+    if (row.chunks()) {
+      if (row.hl_start != in_comment || visible) {
+        row.hl_start = in_comment;
+        row.hl_open_comment = highlightChunks(*row.chunks(), in_comment,
+          visible ? coloff : 0, visible ? coloff + cols : 0);
+      }
+    } else if (row.hl_start != in_comment ||
+    (visible && row.highlight().length() != row.rendered().length())) {
+      row.hl_start = in_comment;
+      if (visible) {
+        row.hl_open_comment = highlightRow(row.rendered(), in_comment,
+          row.paint());
+      } else {
+        row.hl_open_comment = highlightRow(row.rendered(), in_comment,
+          hl_scratch);
+        row.unpaint();
+      }
+    }
+    in_comment = row.hl_open_comment;
+  }
 
-  int scs_len = scs.length();
-  int mcs_len = mcs.length();
-  int mce_len = mce.length();
+  hl_frontier = std::max(hl_frontier, last);
+}
 
-  bool prev_sep = true;
-  int in_string = 0;
-  int in_comment = (row.idx > 0 && rows[row.idx - 1].hl_open_comment);
+// Brings the chunk checkpoints of a long row up to date from the state it
+// opens in and keeps highlighting only for the chunks overlapping render
+// columns [from, to). The pass starts at the first dirty or visible chunk
+// and stops once the states it produces agree with what the chunks after
+// it already started from. Returns the comment state the row ends in.
+int Editor::highlightChunks(ChunkList& list, int in_comment, std::size_t from,
+std::size_t to) {
+  std::size_t reach = std::max({ syntax->keyword_table.max_length,
+    syntax->singleline_comment_start.length(),
+    syntax->multiline_comment_start.length(),
+    syntax->multiline_comment_end.length() }) + 1;
+
+  auto& chunks = list.chunks;
+  std::size_t first = chunks.size(), last = 0;
+  if (from < to) {
+    first = list.atRender(from);
+    last = list.atRender(to - 1) + 1;
+  }
 
-  std::size_t i = 0;
-  while (i < row.render.length()) {
-    char c = row.render[i];
-    HL prev_hl = (i > 0) ? row.hl[i - 1] : HL::NORMAL;
+  HLState state = { in_comment, 0, true, false, HL::NORMAL, 0, HL::NORMAL };
+  std::size_t k = std::min(first, list.dirty.empty() ? chunks.size() :
+    list.dirty.first);
+  std::size_t end = std::max(last, list.dirty.last);
+  if (chunks[0].hl_in != state) {
+    k = 0;
+  } else if (k > 0) {
+    state = chunks[k - 1].hl_out;
+  }
 
-    if (scs_len && !in_string && !in_comment) {
-      if (!row.render.compare(i, scs_len, scs)) {
-        std::fill(row.hl.begin() + i, row.hl.end(), HL::COMMENT);
+  std::string window;
+  for (; k < chunks.size(); k++) {
+    Chunk& chunk = chunks[k];
+    bool visible = (k >= first && k < last);
+    if (chunk.hl_in == state &&
+    (!visible || chunk.hl.length() == chunk.width)) {
+      if (k >= end) {
         break;
       }
+      state = chunk.hl_out;
+      continue;
     }
 
-    if (mcs_len && mce_len && !in_string) {
-      if (in_comment) {
-        row.hl[i] = HL::MLCOMMENT;
-        if (!row.render.compare(i, mce_len, mce)) {
-          std::fill(row.hl.begin() + i, row.hl.begin() + i + mce_len,
-            HL::COMMENT);
-          i += mce_len;
-          in_comment = 0;
-          prev_sep = true;
-          continue;
-        } else {
-          i++;
-          continue;
-        }
-      } else if (!row.render.compare(i, mcs_len, mcs)) {
-        std::fill(row.hl.begin() + i, row.hl.begin() + i + mce_len, HL::COMMENT);
-        i += mcs_len;
-        in_comment = 1;
-        continue;
-      }
+    window.assign(chunk.rendered());
+    auto want = chunk.width + reach;
+    for (auto j = k + 1; j < chunks.size() && window.length() < want; j++) {
+      window.append(chunks[j].rendered().substr(0, want - window.length()));
     }
+    chunk.hl_in = state;
+    highlight(window, chunk.width, state, visible ? chunk.hl : hl_scratch);
+    chunk.hl_out = state;
+  }
+  list.dirty = ChunkRange();
 
-    if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
-      if (in_string) {
-        row.hl[i] = HL::STRING;
-        if (c == '\\' && i + 1 < row.render.length()) {
-          row.hl[i + 1] = HL::STRING;
-          i += 2;
-          continue;
-        }
-        if (c == in_string) {
-          in_string = 0;
-        }
-        i++;
-        prev_sep = true;
-        continue;
-      } else {
-        if (c == '"' || c == '\'') {
-          in_string = c;
-          row.hl[i] = HL::STRING;
-          i++;
-          continue;
-        }
-      }
+  auto painted_last = std::min(list.painted.last, chunks.size());
+  for (auto j = list.painted.first; j < painted_last; j++) {
+    if (j < first || j >= last) {
+      chunks[j].hl.clear();
     }
+  }
+  list.painted = ChunkRange();
+  if (first < last) {
+    list.painted.add(first);
+    list.painted.add(last - 1);
+  }
 
-    if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-      if ((isdigit(c) && (prev_sep || prev_hl == HL::NUMBER)) ||
-      (c == '.' && prev_hl == HL::NUMBER)) {
-        row.hl[i] = HL::NUMBER;
-        i++;
-        prev_sep = false;
-        continue;
-      }
-    }
+  return chunks.back().hl_out.in_comment;
+}
 
-    if (prev_sep) {
-      bool found = false;
-      for (auto& keyword: syntax->keywords) {
-        auto klen = keyword.length();
-        int kw2 = keyword[klen - 1] == '|';
-        if (kw2) {
-          klen--;
-        }
-        if (!row.render.compare(i, klen, keyword) &&
-            is_separator(row.render[i + klen])) {
-            std::fill(row.hl.begin() + i, row.hl.begin() + i + klen,
-              kw2 ? HL::KEYWORD2 : HL::KEYWORD1);
+int Editor::highlightRow(std::string_view render, int in_comment,
+Highlight& hl) {
+  HLState state = { in_comment, 0, true, false, HL::NORMAL, 0, HL::NORMAL };
+  highlight(render, render.length(), state, hl);
+  return state.in_comment;
+}
 
-          i += klen;
-          found = true;
-          break;
-        }
-      }
-      if (!found) {
-        prev_sep = 0;
-        continue;
-      }
-    }
+// Highlights render[0, stop) carrying on from state with the highlighter
+// of the current syntax.
+void Editor::highlight(std::string_view render, std::size_t stop,
+HLState& state, Highlight& hl) {
+  syntax->highlighter(*syntax, render, stop, state, hl);
+}
 
-    prev_sep = is_separator(c);
-    i++;
+void Editor::writeProfile(Screen& screen) {
+#ifdef KILO_PROFILE
+  auto fn = prompt(screen, "Write profile to: %s (ESC to cancel)",
+    std::nullopt);
+  if (fn.empty()) {
+    setStatusMessage("Profile not written");
+    return;
   }
 
-  int changed = (row.hl_open_comment != in_comment);
-  row.hl_open_comment = in_comment;
-  if (changed && row.idx + 1 < rows.size()) {
-    updateSyntax(rows[row.idx + 1]);
+  std::ofstream out(fn);
+  out << profile.dump();
+  out.close();
+  if (!out) {
+    setStatusMessage("Can't write profile! %s", strerror(errno));
+    return;
   }
+  profile.reset();
+  setStatusMessage("Profile written to %s", fn.c_str());
+#else
+  (void)screen;
+  setStatusMessage("Profiling was not compiled in");
+#endif
 }
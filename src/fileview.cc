@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fileview.h"
+
+constexpr const std::size_t VIEW_BLOCK = 1 << 20;
+
+constexpr const std::size_t VIEW_ROWS = 1024;
+
+constexpr const std::size_t VIEW_STRIDE = 1024;
+
+FileView::FileView() : fd{-1}, size{0}, budget{0}, window{VIEW_ROWS},
+first{0}, known_line{0}, known_offset{0}, eof{false}, arena{}, lock{},
+offsets{}, stride{VIEW_STRIDE}, counted{0}, finished{false}, stop{false},
+thread{} {
+}
+
+FileView::~FileView() {
+  close();
+}
+
+void FileView::close() {
+  stop.store(true, std::memory_order_relaxed);
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (fd != -1) {
+    ::close(fd);
+  }
+  fd = -1;
+  size = 0;
+}
+
+// Counts the newlines in [pos, end), stopping just past the want'th one.
+// Returns the offset it stopped at.
+std::size_t FileView::countLines(std::size_t pos, std::size_t end,
+std::size_t& count, std::size_t want) {
+  std::string block;
+  count = 0;
+  while (pos < end && count < want) {
+    if (!read(pos, std::min(VIEW_BLOCK, end - pos), block) || block.empty()) {
+      break;
+    }
+    const char* p = block.data();
+    const char* last = p + block.size();
+    while (count < want &&
+    (p = static_cast<const char*>(memchr(p, '\n', last - p)))) {
+      p++;
+      count++;
+    }
+    pos += (count < want) ? block.size() : p - block.data();
+  }
+  return std::min(pos, end);
+}
+
+// Looks for a match from the line starting at start. A forward search
+// takes the first hit at or after at, wrapping to the top of the file; a
+// backward one takes the last hit before at, wrapping to the bottom.
+std::size_t FileView::find(std::size_t start, std::size_t at, bool forward,
+std::size_t overlap, const BlockMatch& match) {
+  if (forward) {
+    auto hit = findForward(start, size, at, overlap, match);
+    return (hit != std::string::npos) ? hit :
+      findForward(0, at, 0, overlap, match);
+  }
+
+  std::size_t n;
+  auto hit = findBackward(countLines(start, size, n, 1), 0, at, overlap,
+    match);
+  return (hit != std::string::npos) ? hit :
+    findBackward(size, at, size + 1, overlap, match);
+}
+
+// Hands match blocks of whole lines ending at end, last block first, and
+// returns the first hit at or after limit. A line longer than a block is
+// cut, with overlap bytes shared between the pieces.
+std::size_t FileView::findBackward(std::size_t end, std::size_t limit,
+std::size_t before, std::size_t overlap, const BlockMatch& match) {
+  std::string block;
+  while (end > limit) {
+    auto pos = end - std::min(end, VIEW_BLOCK);
+    if (!read(pos, end - pos, block) || block.empty()) {
+      break;
+    }
+    bool cut = false;
+    if (pos > 0) {
+      auto nl = block.find('\n');
+      if (nl != std::string::npos && nl + 1 < block.size()) {
+        block.erase(0, nl + 1);
+        pos += nl + 1;
+      } else {
+        cut = true;
+      }
+    }
+
+    auto hit = match(block, (before >= end) ? block.size() + 1 :
+      (before > pos) ? before - pos : 0);
+    if (hit != std::string::npos) {
+      return (pos + hit >= limit) ? pos + hit : std::string::npos;
+    }
+    end = cut ? pos + std::min(overlap, block.size() / 2) : pos;
+  }
+  return std::string::npos;
+}
+
+// Hands match blocks of whole lines from pos on and returns the first hit
+// before limit.
+std::size_t FileView::findForward(std::size_t pos, std::size_t limit,
+std::size_t at, std::size_t overlap, const BlockMatch& match) {
+  std::string block;
+  while (pos < limit) {
+    if (!read(pos, VIEW_BLOCK, block) || block.empty()) {
+      break;
+    }
+    bool cut = false;
+    if (pos + block.size() < size) {
+      auto nl = block.rfind('\n');
+      if (nl != std::string::npos) {
+        block.resize(nl + 1);
+      } else {
+        cut = true;
+      }
+    }
+
+    auto hit = match(block, (at > pos) ? at - pos : 0);
+    if (hit != std::string::npos) {
+      return (pos + hit < limit) ? pos + hit : std::string::npos;
+    }
+    pos += block.size() - (cut ? std::min(overlap, block.size() / 2) : 0);
+  }
+  return std::string::npos;
+}
+
+bool FileView::indexed() const {
+  return finished.load(std::memory_order_acquire);
+}
+
+std::size_t FileView::lineAt(std::size_t offset) {
+  std::size_t line, pos;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto k = std::upper_bound(offsets.begin(), offsets.end(), offset) -
+      offsets.begin() - 1;
+    line = k * stride;
+    pos = offsets[k];
+  }
+  std::size_t n;
+  countLines(pos, offset, n);
+  return line + n;
+}
+
+// Where line starts. Counting goes on from the nearest indexed line or
+// from the last line looked up, whichever is closer, so asking every
+// frame for a line past what is indexed so far costs nothing after the
+// first time.
+std::size_t FileView::lineOffset(std::size_t line) {
+  std::size_t at, pos;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto k = std::min(line / stride, offsets.size() - 1);
+    at = k * stride;
+    pos = offsets[k];
+    if (known_line <= line && known_line > at) {
+      at = known_line;
+      pos = known_offset;
+    }
+  }
+  std::size_t n;
+  pos = countLines(pos, size, n, line - at);
+  if (n == line - at) {
+    std::lock_guard<std::mutex> guard(lock);
+    known_line = line;
+    known_offset = pos;
+  }
+  return pos;
+}
+
+std::size_t FileView::lines() const {
+  return counted.load(std::memory_order_relaxed);
+}
+
+// Replaces rows with the window lines starting at line top. Each row keeps
+// at most its share of an eighth of the budget; the rest of a longer line
+// is not shown. The rows borrow their text from the arena, which the next
+// load frees in one go.
+void FileView::load(RowTree& rows, std::size_t top) {
+  rows.clear();
+  arena.clear();
+  first = top;
+  auto cap = std::max<std::size_t>(budget / 8 / window, 1);
+
+  std::string block, text;
+  bool open = false;
+  auto pos = lineOffset(top);
+  auto next = pos;
+  while (rows.size() < window && pos < size) {
+    if (!read(pos, VIEW_BLOCK, block) || block.empty()) {
+      break;
+    }
+    std::string_view rest = block;
+    while (!rest.empty() && rows.size() < window) {
+      auto nl = rest.find('\n');
+      auto piece = rest.substr(0, nl);
+      if (text.length() < cap) {
+        text.append(piece.substr(0, cap - text.length()));
+      }
+      if (nl == std::string_view::npos) {
+        open = true;
+        break;
+      }
+
+      while (!text.empty() && text.back() == '\r') {
+        text.pop_back();
+      }
+      Row row(arena.add(text), true);
+      row.update();
+      rows.insert(rows.size(), std::move(row));
+      text.clear();
+      open = false;
+      rest.remove_prefix(nl + 1);
+      next = pos + (block.size() - rest.size());
+    }
+    pos += block.size();
+  }
+
+  if (open && rows.size() < window) {
+    Row row(arena.add(text), true);
+    row.update();
+    rows.insert(rows.size(), std::move(row));
+    next = size;
+  }
+  eof = (next >= size);
+}
+
+bool FileView::open(const char* fn, std::size_t limit) {
+  close();
+
+  fd = ::open(fn, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  size = st.st_size;
+  budget = limit;
+  first = 0;
+  known_line = 0;
+  known_offset = 0;
+  eof = false;
+  offsets.assign(1, 0);
+  stride = VIEW_STRIDE;
+  counted.store(0, std::memory_order_relaxed);
+  finished.store(false, std::memory_order_relaxed);
+  stop.store(false, std::memory_order_relaxed);
+  thread = std::thread(&FileView::run, this);
+  return true;
+}
+
+bool FileView::read(std::size_t pos, std::size_t n, std::string& out) const {
+  out.resize(std::min(n, size - std::min(pos, size)));
+  std::size_t got = 0;
+  while (got < out.size()) {
+    ssize_t nread = pread(fd, &out[got], out.size() - got, pos + got);
+    if (nread == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      out.clear();
+      return false;
+    }
+    if (nread == 0) {
+      break;
+    }
+    got += nread;
+  }
+  out.resize(got);
+  return true;
+}
+
+// Builds the sparse line index: the offset of every stride'th line. When
+// the index outgrows an eighth of the budget every other entry is dropped
+// and the stride doubles, so it stays bounded however long the file is.
+void FileView::run() {
+  auto limit = std::max<std::size_t>(budget / 8 / sizeof(std::size_t), 2);
+  std::string block;
+  std::size_t pos = 0;
+  std::size_t line = 0;
+  bool newline = true;
+  while (pos < size && !stop.load(std::memory_order_relaxed)) {
+    if (!read(pos, VIEW_BLOCK, block) || block.empty()) {
+      break;
+    }
+    const char* p = block.data();
+    const char* end = p + block.size();
+    while ((p = static_cast<const char*>(memchr(p, '\n', end - p)))) {
+      p++;
+      if (++line % stride == 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        offsets.push_back(pos + (p - block.data()));
+        if (offsets.size() > limit) {
+          for (std::size_t j = 0; 2 * j < offsets.size(); j++) {
+            offsets[j] = offsets[2 * j];
+          }
+          offsets.resize((offsets.size() + 1) / 2);
+          stride *= 2;
+        }
+      }
+    }
+    newline = (block.back() == '\n');
+    pos += block.size();
+    counted.store(line, std::memory_order_relaxed);
+  }
+
+  if (pos == size && !newline) {
+    counted.store(line + 1, std::memory_order_relaxed);
+  }
+  finished.store(true, std::memory_order_release);
+}
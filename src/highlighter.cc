@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include "highlighter.h"
+#include "syntaxdb.h"
+
+static bool is_separator(int c) {
+  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+// Whether s has with at i. With with known at compile time this comes down
+// to a length check and a compare or two of constant size.
+static inline bool startsAt(std::string_view s, std::size_t i,
+std::string_view with) {
+  return s.length() - i >= with.length() &&
+    std::char_traits<char>::compare(s.data() + i, with.data(),
+      with.length()) == 0;
+}
+
+constexpr std::size_t keywordSlots(std::size_t n) {
+  std::size_t size = 4;
+  while (size < n * 2) {
+    size *= 2;
+  }
+  return size;
+}
+
+// The same lookup as KeywordTable, laid out by the compiler.
+template <std::size_t N>
+struct StaticKeywordTable {
+  constexpr explicit StaticKeywordTable(const StaticKeyword (&list)[N]) :
+  words{}, slots{}, min_length{std::string_view::npos}, max_length{0},
+  first_bytes{} {
+    for (std::size_t j = 0; j < N; j++) {
+      words[j] = list[j];
+      auto len = list[j].word.length();
+      unsigned char first = list[j].word[0];
+      first_bytes[first >> 6] |= std::uint64_t{1} << (first & 63);
+      min_length = std::min(min_length, len);
+      max_length = std::max(max_length, len);
+    }
+
+    for (std::size_t s = 0; s < slots.size(); s++) {
+      slots[s] = -1;
+    }
+    for (std::size_t j = 0; j < N; j++) {
+      auto s = keywordHash(words[j].word) & (slots.size() - 1);
+      while (slots[s] != -1 && words[slots[s]].word != words[j].word) {
+        s = (s + 1) & (slots.size() - 1);
+      }
+      if (slots[s] == -1) {
+        slots[s] = j;
+      }
+    }
+  }
+
+  constexpr HL find(std::string_view token) const {
+    auto len = token.length();
+    if (len == 0 || len < min_length || len > max_length) {
+      return HL::NORMAL;
+    }
+    unsigned char first = token[0];
+    if (!(first_bytes[first >> 6] & (std::uint64_t{1} << (first & 63)))) {
+      return HL::NORMAL;
+    }
+
+    for (auto s = keywordHash(token) & (slots.size() - 1); slots[s] != -1;
+    s = (s + 1) & (slots.size() - 1)) {
+      if (words[slots[s]].word == token) {
+        return words[slots[s]].kind;
+      }
+    }
+    return HL::NORMAL;
+  }
+
+  std::array<StaticKeyword, N> words;
+  std::array<int, keywordSlots(N)> slots;
+  std::size_t min_length;
+  std::size_t max_length;
+  std::uint64_t first_bytes[4];
+};
+
+template <typename Language>
+constexpr StaticKeywordTable compiled_keywords(Language::keywords);
+
+// A language as the highlighter sees it, read from a syntax at run time.
+struct DynamicLanguage {
+  explicit DynamicLanguage(const EditorSyntax& s) : syntax{s} {
+  }
+
+  int flags() const {
+    return syntax.flags;
+  }
+
+  HL keyword(std::string_view token) const {
+    return syntax.keyword_table.find(token);
+  }
+
+  std::string_view multilineCommentEnd() const {
+    return syntax.multiline_comment_end;
+  }
+
+  std::string_view multilineCommentStart() const {
+    return syntax.multiline_comment_start;
+  }
+
+  std::string_view singlelineCommentStart() const {
+    return syntax.singleline_comment_start;
+  }
+
+  const EditorSyntax& syntax;
+};
+
+// A language as the highlighter sees it, taken from a built-in descriptor
+// so that all of it is constant.
+template <typename Language>
+struct StaticLanguage {
+  constexpr explicit StaticLanguage(const EditorSyntax&) {
+  }
+
+  static constexpr int flags() {
+    return Language::flags;
+  }
+
+  static constexpr HL keyword(std::string_view token) {
+    return compiled_keywords<Language>.find(token);
+  }
+
+  static constexpr std::string_view multilineCommentEnd() {
+    return Language::multiline_comment_end;
+  }
+
+  static constexpr std::string_view multilineCommentStart() {
+    return Language::multiline_comment_start;
+  }
+
+  static constexpr std::string_view singlelineCommentStart() {
+    return Language::singleline_comment_start;
+  }
+};
+
+bool HLState::operator==(const HLState& other) const {
+  return in_comment == other.in_comment && in_string == other.in_string &&
+    prev_sep == other.prev_sep && line_comment == other.line_comment &&
+    last == other.last && carry == other.carry && carry_hl == other.carry_hl;
+}
+
+bool HLState::operator!=(const HLState& other) const {
+  return !(*this == other);
+}
+
+// Highlights render[0, stop) for Language carrying on from state, and
+// leaves state as it stands at stop. Anything past stop is only looked at,
+// so a keyword or delimiter that runs over the end of a chunk is still
+// recognised; the part of it in the next chunk is left in state.carry.
+template <typename Language>
+static void highlightAs(const EditorSyntax& syntax, std::string_view render,
+std::size_t stop, HLState& state, Highlight& hl) {
+  Language lang(syntax);
+  hl.assign(render.length(), HL::NORMAL);
+
+  auto scs = lang.singlelineCommentStart();
+  auto mcs = lang.multilineCommentStart();
+  auto mce = lang.multilineCommentEnd();
+
+  int scs_len = scs.length();
+  int mcs_len = mcs.length();
+  int mce_len = mce.length();
+
+  int in_comment = state.in_comment;
+  int in_string = state.in_string;
+  bool prev_sep = state.prev_sep;
+
+  std::size_t i = state.carry;
+  std::fill(hl.begin(), hl.begin() + std::min(i, stop), state.carry_hl);
+  if (state.line_comment) {
+    std::fill(hl.begin(), hl.end(), HL::COMMENT);
+    i = stop;
+  }
+
+  while (i < stop) {
+    char c = render[i];
+    HL prev_hl = (i > 0) ? hl[i - 1] : state.last;
+
+    if (scs_len && !in_string && !in_comment) {
+      if (startsAt(render, i, scs)) {
+        std::fill(hl.begin() + i, hl.end(), HL::COMMENT);
+        state.line_comment = true;
+        i = stop;
+        break;
+      }
+    }
+
+    if (mcs_len && mce_len && !in_string) {
+      if (in_comment) {
+        hl[i] = HL::MLCOMMENT;
+        if (startsAt(render, i, mce)) {
+          std::fill(hl.begin() + i, hl.begin() + i + mce_len,
+            HL::COMMENT);
+          i += mce_len;
+          in_comment = 0;
+          prev_sep = true;
+          continue;
+        } else {
+          i++;
+          continue;
+        }
+      } else if (startsAt(render, i, mcs)) {
+        std::fill(hl.begin() + i, hl.begin() + i + mcs_len, HL::COMMENT);
+        i += mcs_len;
+        in_comment = 1;
+        continue;
+      }
+    }
+
+    if (lang.flags() & HL_HIGHLIGHT_STRINGS) {
+      if (in_string) {
+        hl[i] = HL::STRING;
+        if (c == '\\' && i + 1 < render.length()) {
+          hl[i + 1] = HL::STRING;
+          i += 2;
+          continue;
+        }
+        if (c == in_string) {
+          in_string = 0;
+        }
+        i++;
+        prev_sep = true;
+        continue;
+      } else {
+        if (c == '"' || c == '\'') {
+          in_string = c;
+          hl[i] = HL::STRING;
+          i++;
+          continue;
+        }
+      }
+    }
+
+    if (lang.flags() & HL_HIGHLIGHT_NUMBERS) {
+      if ((isdigit(c) && (prev_sep || prev_hl == HL::NUMBER)) ||
+      (c == '.' && prev_hl == HL::NUMBER)) {
+        hl[i] = HL::NUMBER;
+        i++;
+        prev_sep = false;
+        continue;
+      }
+    }
+
+    if (prev_sep) {
+      auto end = i;
+      while (end < render.length() && !is_separator(render[end])) {
+        end++;
+      }
+      HL kind = lang.keyword(render.substr(i, end - i));
+      if (kind == HL::NORMAL) {
+        prev_sep = 0;
+        continue;
+      }
+      std::fill(hl.begin() + i, hl.begin() + end, kind);
+      i = end;
+      prev_sep = false;
+      continue;
+    }
+
+    prev_sep = is_separator(c);
+    i++;
+  }
+
+  state.in_comment = in_comment;
+  state.in_string = in_string;
+  state.prev_sep = prev_sep;
+  state.carry = i - stop;
+  state.carry_hl = state.carry ? hl[stop] : HL::NORMAL;
+  if (stop > 0) {
+    state.last = hl[stop - 1];
+  }
+  hl.resize(stop);
+}
+
+// The highlighter for syntaxes read from definition files.
+void highlightGeneric(const EditorSyntax& syntax, std::string_view render,
+std::size_t stop, HLState& state, Highlight& hl) {
+  highlightAs<DynamicLanguage>(syntax, render, stop, state, hl);
+}
+
+void highlightC(const EditorSyntax& syntax, std::string_view render,
+std::size_t stop, HLState& state, Highlight& hl) {
+  highlightAs<StaticLanguage<CLanguage>>(syntax, render, stop, state, hl);
+}
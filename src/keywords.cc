@@ -0,0 +1,111 @@
+#include "highlighter.h"
+#include "keywords.h"
+
+KeywordTable::KeywordTable() : text{}, words{}, slots{}, min_length{0},
+max_length{0}, first_bytes{0, 0, 0, 0} {
+}
+
+void KeywordTable::compile(const std::vector<std::string>& keywords) {
+  text.clear();
+  words.clear();
+  min_length = std::string::npos;
+  max_length = 0;
+  for (auto& mask: first_bytes) {
+    mask = 0;
+  }
+
+  for (auto& keyword: keywords) {
+    auto klen = keyword.length();
+    bool kw2 = klen > 0 && keyword[klen - 1] == '|';
+    if (kw2) {
+      klen--;
+    }
+    if (klen == 0) {
+      continue;
+    }
+    words.push_back({ static_cast<std::uint32_t>(text.length()),
+      static_cast<std::uint32_t>(klen), kw2 ? HL::KEYWORD2 : HL::KEYWORD1 });
+    text.append(keyword, 0, klen);
+
+    unsigned char first = keyword[0];
+    first_bytes[first >> 6] |= std::uint64_t{1} << (first & 63);
+    min_length = std::min(min_length, klen);
+    max_length = std::max(max_length, klen);
+  }
+
+  std::size_t size = 4;
+  while (size < words.size() * 2) {
+    size *= 2;
+  }
+  slots.assign(size, -1);
+
+  for (std::size_t j = 0; j < words.size(); j++) {
+    auto s = slot(word(words[j]));
+    while (slots[s] != -1) {
+      if (word(words[slots[s]]) == word(words[j])) {
+        break;
+      }
+      s = (s + 1) & (slots.size() - 1);
+    }
+    if (slots[s] == -1) {
+      slots[s] = j;
+    }
+  }
+}
+
+HL KeywordTable::find(std::string_view token) const {
+  auto len = token.length();
+  if (len == 0 || len < min_length || len > max_length) {
+    return HL::NORMAL;
+  }
+  unsigned char first = token[0];
+  if (!(first_bytes[first >> 6] & (std::uint64_t{1} << (first & 63)))) {
+    return HL::NORMAL;
+  }
+
+  for (auto s = slot(token); slots[s] != -1; s = (s + 1) & (slots.size() - 1)) {
+    auto& keyword = words[slots[s]];
+    if (word(keyword) == token) {
+      return keyword.kind;
+    }
+  }
+  return HL::NORMAL;
+}
+
+std::size_t KeywordTable::slot(std::string_view token) const {
+  return keywordHash(token) & (slots.size() - 1);
+}
+
+// Whether the table is one compile could have built, so that find never
+// reads past its arrays. A table read back from somewhere else has to pass
+// this before it is used.
+bool KeywordTable::valid() const {
+  if (slots.empty() || (slots.size() & (slots.size() - 1)) ||
+  words.size() >= slots.size()) {
+    return false;
+  }
+  for (auto s: slots) {
+    if (s < -1 || (s >= 0 && static_cast<std::size_t>(s) >= words.size())) {
+      return false;
+    }
+  }
+  if (words.empty()) {
+    return true;
+  }
+
+  if (min_length == 0 || min_length > max_length) {
+    return false;
+  }
+  for (auto& keyword: words) {
+    if (std::uint64_t{keyword.offset} + keyword.length > text.size() ||
+    keyword.length < min_length || keyword.length > max_length ||
+    (keyword.kind != HL::KEYWORD1 && keyword.kind != HL::KEYWORD2)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string_view KeywordTable::word(const Keyword& keyword) const {
+  return std::string_view(text).substr(keyword.offset, keyword.length);
+}
@@ -1,20 +1,112 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
 #include "editor.h"
+#include "profile.h"
 #include "screen.h"
 
+#ifndef KILO_DATADIR
+#define KILO_DATADIR "/usr/local/share/kilo"
+#endif
+
+#ifdef KILO_PROFILE
+void* operator new(std::size_t n) {
+  if (profile.enabled.load(std::memory_order_relaxed)) {
+    profile.allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void* p = malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  free(p);
+}
+#endif
+
+// The kilo directory under the XDG base directory named by xdg, or under
+// fallback in the home directory. Empty if neither is known.
+static std::filesystem::path userDir(const char* xdg, const char* fallback) {
+  if (const char* dir = getenv(xdg); dir && *dir) {
+    return std::filesystem::path(dir) / "kilo";
+  }
+  if (const char* home = getenv("HOME"); home && *home) {
+    return std::filesystem::path(home) / fallback / "kilo";
+  }
+  return std::filesystem::path();
+}
+
+// Reads the environment variable name as a whole number into value.
+// Returns whether it is set; set to anything else is an error.
+static bool envNumber(const char* name, unsigned long long& value) {
+  const char* text = getenv(name);
+  if (!text) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  value = strtoull(text, &end, 10);
+  if (errno || end == text || *end != '\0' || strchr(text, '-')) {
+    throw std::string(name) + ": not a valid number: \"" + text + "\"";
+  }
+  return true;
+}
+
 int main(int argc, const char *argv[]) {
   Editor editor;
   Screen screen;
 
   try {
+    unsigned long long value;
+    if (envNumber("KILO_MEMORY_LIMIT", value)) {
+      editor.memory_limit = value;
+    }
+
+    auto config = userDir("XDG_CONFIG_HOME", ".config");
+    auto cache = userDir("XDG_CACHE_HOME", ".cache");
+    if (const char* dir = getenv("KILO_SYNTAX_DIR")) {
+      config = dir;
+    } else if (!config.empty()) {
+      config /= "syntax";
+    }
+    editor.hldb.load(std::filesystem::path(KILO_DATADIR) / "syntax",
+      cache.empty() ? cache : cache / "shared-syntax.cache");
+    if (!config.empty()) {
+      editor.hldb.load(config,
+        cache.empty() ? cache : cache / "syntax.cache");
+    }
+
     if (argc >= 2) {
       editor.openFile(screen, argv[1]);
     }
 
-    editor.setStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+    if (envNumber("KILO_UNDO_LIMIT", value)) {
+      editor.history.limit = value;
+    }
+
+    if (envNumber("KILO_THREADS", value)) {
+      editor.hl_threads = std::max(1ull, value);
+    }
+
+    if (envNumber("KILO_FPS", value)) {
+      editor.frame_interval = std::chrono::microseconds(
+        value ? 1000000 / value : 0);
+    }
+
+    editor.setStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | "
+      "Ctrl-F = find | Ctrl-Z/Y = undo/redo");
 
     bool running = true;
     while (running) {
-      editor.draw(screen);
+      editor.drawFrame(screen);
       running = editor.processKeypress(screen);
     }
 
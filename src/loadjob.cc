@@ -0,0 +1,99 @@
+#include <iterator>
+#include "loadjob.h"
+#include "mappedfile.h"
+
+constexpr const std::size_t LOAD_BATCH = 4096;
+
+constexpr const std::size_t LOAD_CHECK = 256;
+
+LoadJob::LoadJob(const char* text, std::size_t length, std::size_t from) :
+data{text}, size{length}, scanned{from}, finished{false}, stop{false},
+lock{}, ready{}, taken{}, next{0}, thread{} {
+  thread = std::thread(&LoadJob::run, this);
+}
+
+LoadJob::~LoadJob() {
+  stop.store(true, std::memory_order_relaxed);
+  wait();
+}
+
+// Whether every row has been scanned and handed over.
+bool LoadJob::done() {
+  return finished.load(std::memory_order_acquire) && !pending();
+}
+
+// Appends the rows the worker has built so far to rows, stopping once
+// budget has been spent so a keypress is never kept waiting long. Returns
+// whether there are more to take right away.
+bool LoadJob::drain(RowTree& rows, std::chrono::nanoseconds budget) {
+  auto deadline = std::chrono::steady_clock::now() + budget;
+  while (true) {
+    if (next == taken.size()) {
+      taken.clear();
+      next = 0;
+      std::lock_guard<std::mutex> guard(lock);
+      if (ready.empty()) {
+        return false;
+      }
+      std::swap(taken, ready);
+    }
+
+    auto end = std::min(taken.size(), next + LOAD_CHECK);
+    for (; next < end; next++) {
+      rows.insert(rows.size(), std::move(taken[next]));
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return true;
+    }
+  }
+}
+
+// Whether there are rows ready to drain.
+bool LoadJob::pending() {
+  if (next < taken.size()) {
+    return true;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  return !ready.empty();
+}
+
+int LoadJob::progress() const {
+  return size ? scanned.load(std::memory_order_relaxed) * 100 / size : 100;
+}
+
+void LoadJob::run() {
+  std::vector<LineSpan> lines;
+  std::vector<Row> batch;
+  std::size_t pos = scanned.load(std::memory_order_relaxed);
+  while (pos < size && !stop.load(std::memory_order_relaxed)) {
+    lines.clear();
+    pos = scanLines(data, size, pos, lines, LOAD_BATCH);
+    for (auto& line: lines) {
+      Row row(std::string_view(data + line.offset, line.length), true);
+      if (line.tabs) {
+        row.update();
+      }
+      batch.push_back(std::move(row));
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (ready.empty()) {
+        std::swap(ready, batch);
+      } else {
+        ready.insert(ready.end(), std::make_move_iterator(batch.begin()),
+          std::make_move_iterator(batch.end()));
+      }
+    }
+    batch.clear();
+    scanned.store(pos, std::memory_order_relaxed);
+  }
+  finished.store(true, std::memory_order_release);
+}
+
+// Blocks until the worker has scanned the whole file.
+void LoadJob::wait() {
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "mappedfile.h"
+
+MappedFile::MappedFile() : data{nullptr}, size{0}, mapped{false}, buffer{} {
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+void MappedFile::close() {
+  if (mapped) {
+    munmap(const_cast<char*>(data), size);
+  }
+  data = nullptr;
+  size = 0;
+  mapped = false;
+  std::string().swap(buffer);
+}
+
+bool MappedFile::open(const char* fn) {
+  close();
+
+  int fd = ::open(fn, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    return false;
+  }
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      data = static_cast<const char*>(p);
+      size = st.st_size;
+      mapped = true;
+      ::close(fd);
+      return true;
+    }
+  }
+
+  char chunk[65536];
+  ssize_t nread;
+  while ((nread = read(fd, chunk, sizeof(chunk))) > 0) {
+    buffer.append(chunk, nread);
+  }
+  ::close(fd);
+  if (nread == -1) {
+    buffer.clear();
+    return false;
+  }
+  data = buffer.data();
+  size = buffer.size();
+  return true;
+}
+
+#ifdef __SSE2__
+static inline std::uint64_t matchMask(const char* p, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::uint64_t mask = 0;
+  for (auto j = 0; j < 4; j++) {
+    __m128i block =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * j));
+    mask |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)))) << (16 * j);
+  }
+  return mask;
+}
+#endif
+
+static inline void pushLine(const char* data, std::vector<LineSpan>& out,
+std::size_t start, std::size_t end, bool tabs) {
+  while (end > start && data[end - 1] == '\r') {
+    end--;
+  }
+  out.push_back({start, end - start, tabs});
+}
+
+std::size_t scanLines(const char* data, std::size_t size, std::size_t from,
+std::vector<LineSpan>& out, std::size_t max) {
+  std::size_t start = from;
+  std::size_t pos = from;
+  bool tabs = false;
+
+#ifdef __SSE2__
+  while (pos + 64 <= size) {
+    std::uint64_t nl = matchMask(data + pos, '\n');
+    std::uint64_t tb = matchMask(data + pos, '\t');
+
+    while (nl) {
+      auto bit = __builtin_ctzll(nl);
+      auto below = (std::uint64_t{1} << bit) - 1;
+      auto lo = (start > pos) ? start - pos : 0;
+      tabs = tabs || (tb & below) >> lo;
+      pushLine(data, out, start, pos + bit, tabs);
+      start = pos + bit + 1;
+      tabs = false;
+      if (out.size() >= max) {
+        return start;
+      }
+      nl &= nl - 1;
+    }
+
+    auto lo = (start > pos) ? start - pos : 0;
+    tabs = tabs || (lo < 64 && (tb >> lo));
+    pos += 64;
+  }
+#endif
+
+  for (; pos < size; pos++) {
+    if (data[pos] == '\t') {
+      tabs = true;
+    } else if (data[pos] == '\n') {
+      pushLine(data, out, start, pos, tabs);
+      start = pos + 1;
+      tabs = false;
+      if (out.size() >= max) {
+        return start;
+      }
+    }
+  }
+
+  if (start < size) {
+    pushLine(data, out, start, size, tabs);
+  }
+  return size;
+}
@@ -0,0 +1,651 @@
+#include <algorithm>
+#include "pattern.h"
+#include "search.h"
+
+constexpr const std::size_t PATTERN_DFA_MAX = 4096;
+constexpr const std::size_t PATTERN_NFA_MAX = 65536;
+constexpr const int PATTERN_REPEAT_MAX = 256;
+
+constexpr const unsigned char DFA_ACCEPT = 1 << 0;
+constexpr const unsigned char DFA_ACCEPT_END = 1 << 1;
+
+// The parse tree, kept to this file so its names clash with nothing.
+namespace {
+
+enum class NodeKind : unsigned char {
+  EMPTY,
+  BYTES,
+  CONCAT,
+  ALT,
+  REPEAT,
+  BOL,
+  EOL
+};
+
+struct Node {
+  NodeKind kind;
+  ByteSet bytes;
+  std::vector<int> kids;
+  int min;
+  int max;
+};
+
+struct Parser {
+  Parser(std::string_view s, std::vector<Node>& n) : src{s}, pos{0},
+  nodes{n}, error{} {
+  }
+
+  int add(NodeKind kind, ByteSet bytes = {}) {
+    nodes.push_back({kind, bytes, {}, 0, 0});
+    return nodes.size() - 1;
+  }
+
+  bool more() const {
+    return pos < src.length();
+  }
+
+  int fail(const char* msg) {
+    if (error.empty()) {
+      error = msg;
+    }
+    return -1;
+  }
+
+  int alternation();
+  int atom();
+  int concatenation();
+  ByteSet escape(char, bool);
+  int bracket();
+  int repetition();
+  bool count(int&);
+
+  std::string_view src;
+  std::size_t pos;
+  std::vector<Node>& nodes;
+  std::string error;
+};
+
+}
+
+static ByteSet byteRange(unsigned char lo, unsigned char hi) {
+  ByteSet set;
+  for (unsigned c = lo; c <= hi; c++) {
+    set.set(c);
+  }
+  return set;
+}
+
+ByteSet Parser::escape(char c, bool in_class) {
+  ByteSet set;
+  switch (c) {
+    case 'd': case 'D':
+      set = byteRange('0', '9');
+      break;
+    case 'w': case 'W':
+      set = byteRange('0', '9') | byteRange('A', 'Z') | byteRange('a', 'z');
+      set.set('_');
+      break;
+    case 's': case 'S':
+      set = byteRange('\t', '\r');
+      set.set(' ');
+      break;
+    case 't':
+      set.set('\t');
+      return set;
+    case 'n':
+      set.set('\n');
+      return set;
+    case 'r':
+      set.set('\r');
+      return set;
+    default:
+      set.set(static_cast<unsigned char>(c));
+      return set;
+  }
+  if (c >= 'A' && c <= 'Z' && !in_class) {
+    set.flip();
+  }
+  return set;
+}
+
+int Parser::bracket() {
+  ByteSet set;
+  bool negate = more() && src[pos] == '^';
+  if (negate) {
+    pos++;
+  }
+
+  bool first = true;
+  while (more() && (src[pos] != ']' || first)) {
+    first = false;
+    unsigned char lo = src[pos++];
+    if (lo == '\\') {
+      if (!more()) {
+        break;
+      }
+      auto c = src[pos++];
+      auto escaped = escape(c, true);
+      if (escaped.count() != 1) {
+        set |= (c >= 'A' && c <= 'Z') ? ~escaped : escaped;
+        continue;
+      }
+      lo = static_cast<unsigned char>(c == 't' ? '\t' : c == 'n' ? '\n' :
+        c == 'r' ? '\r' : c);
+    }
+    if (pos + 1 < src.length() && src[pos] == '-' && src[pos + 1] != ']') {
+      unsigned char hi = src[pos + 1];
+      pos += 2;
+      if (hi == '\\' && more()) {
+        hi = src[pos++];
+      }
+      if (hi < lo) {
+        return fail("bad range in []");
+      }
+      set |= byteRange(lo, hi);
+    } else {
+      set.set(lo);
+    }
+  }
+
+  if (!more()) {
+    return fail("unterminated [");
+  }
+  pos++;
+  if (negate) {
+    set.flip();
+  }
+  return add(NodeKind::BYTES, set);
+}
+
+int Parser::atom() {
+  char c = src[pos++];
+  switch (c) {
+    case '(': {
+      if (src.substr(pos, 2) == "?:") {
+        pos += 2;
+      }
+      int inner = alternation();
+      if (inner < 0) {
+        return inner;
+      }
+      if (!more() || src[pos] != ')') {
+        return fail("unmatched (");
+      }
+      pos++;
+      return inner;
+    }
+    case '[':
+      return bracket();
+    case '.':
+      return add(NodeKind::BYTES, ByteSet{}.set());
+    case '^':
+      return add(NodeKind::BOL);
+    case '$':
+      return add(NodeKind::EOL);
+    case '\\':
+      if (!more()) {
+        return fail("trailing \\");
+      }
+      return add(NodeKind::BYTES, escape(src[pos++], false));
+    case '*': case '+': case '?':
+      return fail("nothing to repeat");
+    default:
+      return add(NodeKind::BYTES,
+        ByteSet{}.set(static_cast<unsigned char>(c)));
+  }
+}
+
+bool Parser::count(int& n) {
+  if (!more() || src[pos] < '0' || src[pos] > '9') {
+    return false;
+  }
+  n = 0;
+  while (more() && src[pos] >= '0' && src[pos] <= '9') {
+    n = std::min(n * 10 + (src[pos++] - '0'), PATTERN_REPEAT_MAX + 1);
+  }
+  return true;
+}
+
+int Parser::repetition() {
+  int node = atom();
+  while (node >= 0 && more()) {
+    int min, max;
+    char c = src[pos];
+    if (c == '*') {
+      min = 0;
+      max = -1;
+      pos++;
+    } else if (c == '+') {
+      min = 1;
+      max = -1;
+      pos++;
+    } else if (c == '?') {
+      min = 0;
+      max = 1;
+      pos++;
+    } else if (c == '{') {
+      auto saved = pos++;
+      if (!count(min)) {
+        pos = saved;
+        break;
+      }
+      max = min;
+      if (more() && src[pos] == ',') {
+        pos++;
+        if (!count(max)) {
+          max = -1;
+        }
+      }
+      if (!more() || src[pos] != '}') {
+        pos = saved;
+        break;
+      }
+      pos++;
+      if (min > PATTERN_REPEAT_MAX || max > PATTERN_REPEAT_MAX ||
+      (max >= 0 && max < min)) {
+        return fail("bad {} repeat");
+      }
+    } else {
+      break;
+    }
+
+    int repeat = add(NodeKind::REPEAT);
+    nodes[repeat].kids.push_back(node);
+    nodes[repeat].min = min;
+    nodes[repeat].max = max;
+    node = repeat;
+  }
+  return node;
+}
+
+int Parser::concatenation() {
+  int node = add(NodeKind::CONCAT);
+  while (more() && src[pos] != '|' && src[pos] != ')') {
+    int kid = repetition();
+    if (kid < 0) {
+      return kid;
+    }
+    nodes[node].kids.push_back(kid);
+  }
+  return node;
+}
+
+int Parser::alternation() {
+  int node = concatenation();
+  if (node < 0 || !more() || src[pos] != '|') {
+    return node;
+  }
+
+  int alt = add(NodeKind::ALT);
+  nodes[alt].kids.push_back(node);
+  while (more() && src[pos] == '|') {
+    pos++;
+    int kid = concatenation();
+    if (kid < 0) {
+      return kid;
+    }
+    nodes[alt].kids.push_back(kid);
+  }
+  return alt;
+}
+
+static int addState(std::vector<NfaState>& nfa, NfaKind kind, int out = -1,
+int out1 = -1, ByteSet bytes = {}) {
+  nfa.push_back({kind, bytes, out, out1});
+  return nfa.size() - 1;
+}
+
+static int compileNode(const std::vector<Node>& nodes, int n, int next,
+bool reverse, std::vector<NfaState>& nfa) {
+  if (nfa.size() > PATTERN_NFA_MAX) {
+    return next;
+  }
+
+  const Node& node = nodes[n];
+  switch (node.kind) {
+    case NodeKind::EMPTY:
+      return next;
+    case NodeKind::BYTES:
+      return addState(nfa, NfaKind::BYTES, next, -1, node.bytes);
+    case NodeKind::BOL:
+      return addState(nfa, reverse ? NfaKind::EOL : NfaKind::BOL, next);
+    case NodeKind::EOL:
+      return addState(nfa, reverse ? NfaKind::BOL : NfaKind::EOL, next);
+    case NodeKind::CONCAT:
+      if (reverse) {
+        for (auto kid: node.kids) {
+          next = compileNode(nodes, kid, next, reverse, nfa);
+        }
+      } else {
+        for (auto k = node.kids.rbegin(); k != node.kids.rend(); ++k) {
+          next = compileNode(nodes, *k, next, reverse, nfa);
+        }
+      }
+      return next;
+    case NodeKind::ALT: {
+      int alt = compileNode(nodes, node.kids.back(), next, reverse, nfa);
+      for (auto k = node.kids.rbegin() + 1; k != node.kids.rend(); ++k) {
+        alt = addState(nfa, NfaKind::SPLIT,
+          compileNode(nodes, *k, next, reverse, nfa), alt);
+      }
+      return alt;
+    }
+    case NodeKind::REPEAT: {
+      int kid = node.kids[0];
+      int tail = next;
+      if (node.max < 0) {
+        tail = addState(nfa, NfaKind::SPLIT, -1, next);
+        nfa[tail].out = compileNode(nodes, kid, tail, reverse, nfa);
+      } else {
+        for (auto j = node.min; j < node.max; j++) {
+          tail = addState(nfa, NfaKind::SPLIT,
+            compileNode(nodes, kid, tail, reverse, nfa), next);
+        }
+      }
+      for (auto j = 0; j < node.min; j++) {
+        tail = compileNode(nodes, kid, tail, reverse, nfa);
+      }
+      return tail;
+    }
+  }
+  return next;
+}
+
+static bool singleByte(const Node& node, char& c) {
+  if (node.kind != NodeKind::BYTES || node.bytes.count() != 1) {
+    return false;
+  }
+  for (unsigned j = 0; j < 256; j++) {
+    if (node.bytes[j]) {
+      c = static_cast<char>(j);
+    }
+  }
+  return true;
+}
+
+static std::string requiredLiteral(const std::vector<Node>& nodes, int n) {
+  const Node& node = nodes[n];
+  char c;
+  if (singleByte(node, c)) {
+    return std::string(1, c);
+  }
+
+  if (node.kind == NodeKind::REPEAT) {
+    return (node.min > 0) ? requiredLiteral(nodes, node.kids[0]) : "";
+  } else if (node.kind != NodeKind::CONCAT) {
+    return "";
+  }
+
+  std::string best, run;
+  for (auto kid: node.kids) {
+    auto kind = nodes[kid].kind;
+    if (singleByte(nodes[kid], c)) {
+      run += c;
+    } else if (kind != NodeKind::BOL && kind != NodeKind::EOL &&
+    kind != NodeKind::EMPTY) {
+      auto inner = requiredLiteral(nodes, kid);
+      if (run.length() > best.length()) {
+        best = run;
+      }
+      if (inner.length() > best.length()) {
+        best = inner;
+      }
+      run.clear();
+    }
+  }
+  return (run.length() > best.length()) ? run : best;
+}
+
+Automaton::Automaton() : nfa{}, nfa_start{-1}, table{}, sets{}, flags{},
+cache{}, starts{-1, -1} {
+}
+
+bool Automaton::accepts(int state, bool end) const {
+  return flags[state] & (end ? DFA_ACCEPT_END : DFA_ACCEPT);
+}
+
+void Automaton::clear() {
+  table.clear();
+  sets.clear();
+  flags.clear();
+  cache.clear();
+  starts[0] = starts[1] = -1;
+  add({});
+}
+
+void Automaton::closure(std::vector<int>& set, bool begin, bool end) const {
+  std::vector<int> stack(set);
+  std::vector<bool> seen(nfa.size());
+  set.clear();
+
+  while (!stack.empty()) {
+    int s = stack.back();
+    stack.pop_back();
+    if (s < 0 || seen[s]) {
+      continue;
+    }
+    seen[s] = true;
+
+    const NfaState& state = nfa[s];
+    switch (state.kind) {
+      case NfaKind::SPLIT:
+        stack.push_back(state.out1);
+        stack.push_back(state.out);
+        break;
+      case NfaKind::BOL:
+        if (begin) {
+          stack.push_back(state.out);
+        }
+        break;
+      case NfaKind::EOL:
+        if (end) {
+          stack.push_back(state.out);
+        } else {
+          set.push_back(s);
+        }
+        break;
+      default:
+        set.push_back(s);
+    }
+  }
+  std::sort(set.begin(), set.end());
+}
+
+int Automaton::add(std::vector<int>&& set) {
+  auto found = cache.find(set);
+  if (found != cache.end()) {
+    return found->second;
+  }
+
+  unsigned char flag = 0;
+  bool begin = !set.empty() && set[0] < 0;
+  std::vector<int> at_end;
+  for (auto s: set) {
+    if (s < 0) {
+      continue;
+    } else if (nfa[s].kind == NfaKind::MATCH) {
+      flag |= DFA_ACCEPT | DFA_ACCEPT_END;
+    } else if (nfa[s].kind == NfaKind::EOL) {
+      at_end.push_back(s);
+    }
+  }
+  if (!(flag & DFA_ACCEPT_END) && !at_end.empty()) {
+    closure(at_end, begin, true);
+    for (auto s: at_end) {
+      if (nfa[s].kind == NfaKind::MATCH) {
+        flag |= DFA_ACCEPT_END;
+      }
+    }
+  }
+
+  int state = sets.size();
+  table.resize(table.size() + 256, -1);
+  flags.push_back(flag);
+  cache.emplace(set, state);
+  sets.push_back(std::move(set));
+  return state;
+}
+
+int Automaton::start(bool begin) {
+  int& state = starts[begin];
+  if (state < 0) {
+    std::vector<int> set{nfa_start};
+    closure(set, begin, false);
+    if (begin) {
+      set.insert(set.begin(), -1);
+    }
+    state = add(std::move(set));
+  }
+  return state;
+}
+
+int Automaton::step(int state, unsigned char c) {
+  int next = table[state * 256 + c];
+  if (next >= 0) {
+    return next;
+  }
+
+  std::vector<int> set;
+  for (auto s: sets[state]) {
+    if (s >= 0 && nfa[s].kind == NfaKind::BYTES && nfa[s].bytes[c]) {
+      set.push_back(nfa[s].out);
+    }
+  }
+  closure(set, false, false);
+
+  if (sets.size() >= PATTERN_DFA_MAX) {
+    auto from = sets[state];
+    clear();
+    state = add(std::move(from));
+  }
+  next = add(std::move(set));
+  table[state * 256 + c] = next;
+  return next;
+}
+
+Pattern::Pattern() : error{}, required{}, forward{}, reverse{}, skip{} {
+}
+
+bool Pattern::compile(std::string_view src) {
+  std::vector<Node> nodes;
+  Parser parser(src, nodes);
+  int root = parser.alternation();
+  if (root >= 0 && parser.more()) {
+    parser.fail("unmatched )");
+    root = -1;
+  }
+  error = parser.error;
+  if (root < 0) {
+    return false;
+  }
+
+  required = requiredLiteral(nodes, root);
+
+  for (auto automaton: { &forward, &reverse }) {
+    bool backwards = automaton == &reverse;
+    auto& nfa = automaton->nfa;
+    nfa.clear();
+    int match = addState(nfa, NfaKind::MATCH);
+    automaton->nfa_start = compileNode(nodes, root, match, backwards, nfa);
+    if (nfa.size() > PATTERN_NFA_MAX) {
+      error = "pattern too large";
+      return false;
+    }
+    if (backwards) {
+      int loop = addState(nfa, NfaKind::SPLIT, automaton->nfa_start);
+      nfa[loop].out1 = addState(nfa, NfaKind::BYTES, loop, -1,
+        ByteSet{}.set());
+      automaton->nfa_start = loop;
+    }
+    automaton->clear();
+  }
+
+  int idle = reverse.start(false);
+  for (unsigned c = 0; c < 256; c++) {
+    skip[c] = !reverse.accepts(idle, false) && reverse.step(idle, c) == idle;
+  }
+  return true;
+}
+
+std::size_t Pattern::longest(std::string_view text, std::size_t from) {
+  std::size_t length = 0;
+  int state = forward.start(from == 0);
+  for (auto pos = from; ; pos++) {
+    if (forward.accepts(state, pos == text.length())) {
+      length = pos - from;
+    }
+    if (pos == text.length()) {
+      break;
+    }
+    state = forward.step(state, text[pos]);
+    if (state == 0) {
+      break;
+    }
+  }
+  return length;
+}
+
+std::size_t Pattern::find(std::string_view text, std::size_t from,
+std::size_t& length) {
+  if (from > text.length() || (!required.empty() &&
+  findText(text, required, from) == std::string_view::npos)) {
+    return std::string_view::npos;
+  }
+
+  auto match = std::string_view::npos;
+  auto bytes = reinterpret_cast<const unsigned char*>(text.data());
+  int idle = reverse.start(false);
+  int state = reverse.start(true);
+  const int* table = reverse.table.data();
+  for (auto pos = text.length(); ; pos--) {
+    if (state == idle) {
+      while (pos >= from + 8 && skip[bytes[pos - 1]] & skip[bytes[pos - 2]] &
+      skip[bytes[pos - 3]] & skip[bytes[pos - 4]] & skip[bytes[pos - 5]] &
+      skip[bytes[pos - 6]] & skip[bytes[pos - 7]] & skip[bytes[pos - 8]]) {
+        pos -= 8;
+      }
+      while (pos > from && skip[bytes[pos - 1]]) {
+        pos--;
+      }
+    }
+    if (reverse.flags[state] && reverse.accepts(state, pos == 0)) {
+      match = pos;
+    }
+    if (pos == from) {
+      break;
+    }
+    int next = table[state * 256 + bytes[pos - 1]];
+    if (next < 0) {
+      next = reverse.step(state, bytes[pos - 1]);
+      table = reverse.table.data();
+      idle = reverse.start(false);
+    }
+    state = next;
+  }
+
+  if (match != std::string_view::npos) {
+    length = longest(text, match);
+  }
+  return match;
+}
+
+std::size_t Pattern::rfind(std::string_view text, std::size_t before,
+std::size_t& length) {
+  if (before == 0 || (!required.empty() &&
+  findText(text, required) == std::string_view::npos)) {
+    return std::string_view::npos;
+  }
+
+  int state = reverse.start(true);
+  for (auto pos = text.length(); ; pos--) {
+    if (pos < before && reverse.accepts(state, pos == 0)) {
+      length = longest(text, pos);
+      return pos;
+    }
+    if (pos == 0) {
+      break;
+    }
+    state = reverse.step(state, text[pos - 1]);
+  }
+  return std::string_view::npos;
+}
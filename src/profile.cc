@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "profile.h"
+
+static const char* const PHASE_NAMES[PROFILE_PHASES] = {
+  "input", "edit", "highlight", "render", "write", "wait"
+};
+
+static const char* const PHASE_TAGS[PROFILE_PHASES] = {
+  "in", "ed", "hl", "rd", "wr", "wt"
+};
+
+Profile profile;
+
+static ProfileScope* current = nullptr;
+
+Histogram::Histogram() : buckets{}, count{0}, total{0}, max{0} {
+}
+
+void Histogram::add(std::uint64_t ns) {
+  std::size_t bucket = ns;
+  if (ns >= 4) {
+    int msb = 63 - __builtin_clzll(ns);
+    bucket = (msb - 1) * 4 + ((ns >> (msb - 2)) & 3);
+  }
+  buckets[bucket]++;
+  count++;
+  total += ns;
+  max = std::max(max, ns);
+}
+
+std::uint64_t Histogram::lower(std::size_t bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  std::size_t msb = bucket / 4 + 1;
+  return (4 + bucket % 4) << (msb - 2);
+}
+
+// The upper edge of the bucket holding the given percentile.
+std::uint64_t Histogram::percentile(unsigned percent) const {
+  std::uint64_t want = (count * percent + 99) / 100;
+  std::uint64_t seen = 0;
+  for (std::size_t j = 0; j + 1 < std::size(buckets); j++) {
+    seen += buckets[j];
+    if (seen >= want && seen > 0) {
+      return std::min(lower(j + 1), max);
+    }
+  }
+  return max;
+}
+
+Profile::Profile() : enabled{false}, allocations{0}, phases{}, bytes{0},
+frames{0} {
+}
+
+void Profile::addBytes(std::size_t n) {
+  if (enabled.load(std::memory_order_relaxed)) {
+    bytes += n;
+    frames++;
+  }
+}
+
+static std::string usec(std::uint64_t ns) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), (ns < 10000) ? "%.1f" : "%.0f", ns / 1000.0);
+  return buf;
+}
+
+std::string Profile::dump() const {
+  std::string out;
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%-10s %10s %10s %10s %10s %10s\n", "phase",
+    "count", "mean us", "p50 us", "p99 us", "max us");
+  out += buf;
+  for (std::size_t p = 0; p < PROFILE_PHASES; p++) {
+    const Histogram& h = phases[p];
+    snprintf(buf, sizeof(buf), "%-10s %10lu %10s %10s %10s %10s\n",
+      PHASE_NAMES[p], h.count, usec(h.count ? h.total / h.count : 0).c_str(),
+      usec(h.percentile(50)).c_str(), usec(h.percentile(99)).c_str(),
+      usec(h.max).c_str());
+    out += buf;
+  }
+
+  auto keys = std::max<std::uint64_t>(phases[int(Phase::EDIT)].count, 1);
+  snprintf(buf, sizeof(buf), "\nbytes written %zu in %zu frames\n"
+    "allocations %zu in %lu keys\n", bytes, frames,
+    allocations.load(std::memory_order_relaxed),
+    phases[int(Phase::EDIT)].count);
+  out += buf;
+  snprintf(buf, sizeof(buf), "%zu bytes/frame, %.1f allocations/key\n",
+    frames ? bytes / frames : 0,
+    allocations.load(std::memory_order_relaxed) / double(keys));
+  out += buf;
+
+  for (std::size_t p = 0; p < PROFILE_PHASES; p++) {
+    const Histogram& h = phases[p];
+    snprintf(buf, sizeof(buf), "\n%s\n", PHASE_NAMES[p]);
+    out += buf;
+    for (std::size_t j = 0; j + 1 < std::size(h.buckets); j++) {
+      if (h.buckets[j]) {
+        snprintf(buf, sizeof(buf), "  < %12lu ns %10lu\n",
+          Histogram::lower(j + 1), h.buckets[j]);
+        out += buf;
+      }
+    }
+  }
+  return out;
+}
+
+// One status bar line of p50/p99 per phase plus bytes and allocations.
+std::string Profile::overlay() const {
+  std::string out = "us p50/99";
+  for (std::size_t p = 0; p < int(Phase::WAIT); p++) {
+    const Histogram& h = phases[p];
+    out.append(" ").append(PHASE_TAGS[p]).append(" ")
+      .append(usec(h.percentile(50))).append("/")
+      .append(usec(h.percentile(99)));
+  }
+
+  char buf[64];
+  auto keys = std::max<std::uint64_t>(phases[int(Phase::EDIT)].count, 1);
+  snprintf(buf, sizeof(buf), " | %zu B/f %.0f a/k", frames ? bytes / frames : 0,
+    allocations.load(std::memory_order_relaxed) / double(keys));
+  return out + buf;
+}
+
+void Profile::reset() {
+  allocations.store(0, std::memory_order_relaxed);
+  std::fill(std::begin(phases), std::end(phases), Histogram());
+  bytes = 0;
+  frames = 0;
+}
+
+ProfileScope::ProfileScope(Phase p) : phase{p},
+on{profile.enabled.load(std::memory_order_relaxed)}, start{}, nested{0},
+parent{nullptr} {
+  if (on) {
+    parent = current;
+    current = this;
+    start = std::chrono::steady_clock::now();
+  }
+}
+
+ProfileScope::~ProfileScope() {
+  if (!on) {
+    return;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  profile.phases[int(phase)].add((elapsed - nested).count());
+  current = parent;
+  if (parent) {
+    parent->nested += elapsed;
+  }
+}
@@ -1,78 +1,304 @@
+#include <algorithm>
 #include "row.h"
 
-constexpr const std::size_t KILO_TAB_STOP = 8;
+// Rows longer than this are kept as a ChunkList so edits, drawing and
+// cursor mapping only touch the chunks near the cursor. A chunked row goes
+// back to flat storage once it has shrunk to half of it.
+constexpr const std::size_t KILO_LONG_LINE = 1 << 18;
 
-Row::Row(std::size_t at, const char *s) : idx{at}, chars{s},
-render{}, hl{}, hl_open_comment{0} {
+static const Highlight unpainted;
+
+RowExtra::RowExtra() : tabs{}, chunks{}, hl{} {
+}
+
+RowExtra::RowExtra(const RowExtra& other) :
+tabs{other.tabs ? std::make_unique<Expansion>(*other.tabs) : nullptr},
+chunks{other.chunks ? std::make_unique<ChunkList>(*other.chunks) : nullptr},
+hl{other.hl} {
 }
 
-void Row::append(std::string s) {
-  chars += s;
-  update();
+static RowExtra& extend(Row& row) {
+  if (!row.extra) {
+    row.extra = std::make_unique<RowExtra>();
+  }
+  return *row.extra;
 }
 
-void Row::erase(std::size_t at) {
-  if (at >= chars.length()) {
+Row::Row(std::string_view s, bool borrowed) :
+chars{(s.length() > KILO_LONG_LINE) ? std::string_view() : s, borrowed},
+extra{}, hl_start{-1}, hl_open_comment{0}, tabbed{false} {
+  if (s.length() > KILO_LONG_LINE) {
+    extend(*this).chunks = std::make_unique<ChunkList>(s, borrowed);
+  }
+}
+
+Row::Row(const Row& other) : chars{other.chars},
+extra{other.extra ? std::make_unique<RowExtra>(*other.extra) : nullptr},
+hl_start{other.hl_start}, hl_open_comment{other.hl_open_comment},
+tabbed{other.tabbed} {
+}
+
+Row& Row::operator=(const Row& other) {
+  if (this != &other) {
+    chars = other.chars;
+    extra = other.extra ? std::make_unique<RowExtra>(*other.extra) : nullptr;
+    hl_start = other.hl_start;
+    hl_open_comment = other.hl_open_comment;
+    tabbed = other.tabbed;
+  }
+  return *this;
+}
+
+void Row::append(std::string_view s) {
+  splice(length(), 0, s);
+}
+
+ChunkList* Row::chunks() const {
+  return extra ? extra->chunks.get() : nullptr;
+}
+
+void Row::erase(std::size_t at, std::size_t n) {
+  if (at >= length()) {
     return;
   }
-  chars.erase(at, 1);
-  update();
+  splice(at, std::min(n, length() - at), {});
+}
+
+// The highlighting painted for rendered(), empty unless the row is on
+// screen.
+const Highlight& Row::highlight() const {
+  return extra ? extra->hl : unpainted;
 }
 
 void Row::insert(std::size_t at, int c) {
-  if (at > chars.length()) {
-    at = chars.length();
+  char ch = c;
+  insert(at, std::string_view(&ch, 1));
+}
+
+void Row::insert(std::size_t at, std::string_view s) {
+  if (at > length()) {
+    at = length();
   }
-  chars.insert(at, 1, c);
-  update();
+  splice(at, 0, s);
 }
 
-void Row::update() {
-  int tabs = 0;
-  for (auto& j: chars) {
-    if (j == '\t') {
-      tabs++;
+std::size_t Row::length() const {
+  auto list = chunks();
+  return list ? list->length() : chars.length();
+}
+
+// The highlighting to paint rendered() into, expanding the row first.
+Highlight& Row::paint() {
+  expand();
+  return extend(*this).hl;
+}
+
+// The row as drawn. A row with tabs that has not been expanded gives its
+// chars, which is still good enough to carry the highlighting state.
+std::string_view Row::rendered() const {
+  auto expansion = tabs();
+  return expansion ? std::string_view(expansion->render) :
+    std::string_view(chars);
+}
+
+// Replaces chars[at, at + removed) with s and, if the row is expanded,
+// patches render and the tab index in place. Only the edited span and the
+// tab after it are expanded again. The shift past that tab is a whole
+// number of tab stops, so later tabs keep their widths.
+void Row::splice(std::size_t at, std::size_t removed, std::string_view s) {
+  if (!chunks() && chars.length() - removed + s.length() > KILO_LONG_LINE) {
+    auto& more = extend(*this);
+    more.chunks = std::make_unique<ChunkList>(chars, chars.borrowed());
+    chars = Text();
+    more.tabs.reset();
+    more.hl.clear();
+    tabbed = false;
+  }
+  if (auto list = chunks()) {
+    list->splice(at, removed, s);
+    if (list->length() < KILO_LONG_LINE / 2) {
+      chars = Text(list->substr(0));
+      extra->chunks.reset();
+      update();
+      trim();
+    }
+    return;
+  }
+
+  if (!tabs()) {
+    chars.erase(at, removed);
+    chars.insert(at, s);
+    tabbed = tabbed || s.find('\t') != std::string_view::npos;
+    return;
+  }
+
+  auto& stops = extra->tabs->stops;
+  auto& render = extra->tabs->render;
+  std::size_t rx_a = cxtorx(at);
+  std::size_t rx_b = cxtorx(at + removed);
+  auto by_cx = [](const TabStop& t, std::size_t cx) { return t.cx < cx; };
+  auto first = std::lower_bound(stops.begin(), stops.end(), at, by_cx);
+  auto last = std::lower_bound(first, stops.end(), at + removed, by_cx);
+
+  std::vector<TabStop> added;
+  std::string segment;
+  std::size_t rx = rx_a;
+  for (std::size_t j = 0; j < s.length(); j++) {
+    if (s[j] == '\t') {
+      added.push_back({at + j, rx});
+      segment.append(tabEnd(rx) - rx, ' ');
+      rx = tabEnd(rx);
+    } else {
+      segment += s[j];
+      rx++;
     }
   }
 
-  render.resize(chars.length() + tabs*(KILO_TAB_STOP - 1));
+  chars.erase(at, removed);
+  chars.insert(at, s);
+  render.replace(rx_a, rx_b - rx_a, segment);
+
+  std::size_t k = stops.erase(first, last) - stops.begin();
+  stops.insert(stops.begin() + k, added.begin(), added.end());
+  k += added.size();
+
+  if (stops.empty()) {
+    extra->tabs.reset();
+    trim();
+    tabbed = false;
+    return;
+  }
+  if (k == stops.size()) {
+    return;
+  }
+
+  long dcx = static_cast<long>(s.length()) - static_cast<long>(removed);
+  long shift = static_cast<long>(rx) - static_cast<long>(rx_b);
+  TabStop& next = stops[k];
+  std::size_t old_end = tabEnd(next.rx);
+  std::size_t width = old_end - next.rx;
+  next.cx += dcx;
+  next.rx += shift;
+  render.replace(next.rx, width, tabEnd(next.rx) - next.rx, ' ');
+
+  long drx = static_cast<long>(tabEnd(next.rx)) - static_cast<long>(old_end);
+  if (dcx == 0 && drx == 0) {
+    return;
+  }
+  for (auto j = k + 1; j < stops.size(); j++) {
+    stops[j].cx += dcx;
+    stops[j].rx += drx;
+  }
+}
+
+Expansion* Row::tabs() const {
+  return extra ? extra->tabs.get() : nullptr;
+}
+
+std::string Row::text(std::size_t at, std::size_t n) const {
+  auto list = chunks();
+  return list ? list->substr(at, n) :
+    (at < chars.length() ? chars.substr(at, n) : std::string());
+}
+
+// Builds the render and tab index of a row with tabs. Only rows on screen
+// or being edited need them; the rest just know they have tabs.
+void Row::expand() {
+  if (!tabbed || tabs()) {
+    return;
+  }
+
+  auto count = std::count(chars.begin(), chars.end(), '\t');
+  if (count == 0) {
+    tabbed = false;
+    return;
+  }
+
+  auto& more = extend(*this);
+  more.tabs = std::make_unique<Expansion>();
+  auto& render = more.tabs->render;
+  auto& stops = more.tabs->stops;
+  render.reserve(chars.length() + count * (KILO_TAB_STOP - 1));
+  stops.reserve(count);
 
-  int idx = 0;
+  std::size_t cx = 0;
   for (auto& j: chars) {
     if (j == '\t') {
-      render[idx++] = ' ';
-      while (idx % KILO_TAB_STOP != 0) {
-        render[idx++] = ' ';
-      }
+      stops.push_back({cx, render.length()});
+      render.append(tabEnd(render.length()) - render.length(), ' ');
     } else {
-      render[idx++] = j;
+      render += j;
     }
+    cx++;
+  }
+}
+
+// Lets go of the extra once nothing is left in it.
+void Row::trim() {
+  if (extra && !extra->tabs && !extra->chunks && extra->hl.empty()) {
+    extra.reset();
+  }
+}
+
+// Drops what only a row on screen needs, its highlighting and its render.
+void Row::unpaint() {
+  if (extra) {
+    Highlight().swap(extra->hl);
+    extra->tabs.reset();
+    trim();
+  }
+}
+
+// Notes whether chars has tabs after it was changed wholesale. The render
+// is built again when next needed.
+void Row::update() {
+  if (chunks()) {
+    return;
+  }
+
+  tabbed = std::find(chars.begin(), chars.end(), '\t') != chars.end();
+  if (extra) {
+    extra->tabs.reset();
+    trim();
   }
 }
 
 int Row::cxtorx(int cx) {
-  int rx = 0;
-  for (auto j = 0; j < cx; j++) {
-    if (chars[j] == '\t') {
-      rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
-    }
-    rx++;
+  if (auto list = chunks()) {
+    return list->cxtorx(cx);
+  }
+  expand();
+  if (!tabs()) {
+    return cx;
   }
-  return rx;
+
+  auto& stops = extra->tabs->stops;
+  auto it = std::lower_bound(stops.begin(), stops.end(),
+    static_cast<std::size_t>(cx),
+    [](const TabStop& t, std::size_t c) { return t.cx < c; });
+  if (it == stops.begin()) {
+    return cx;
+  }
+  --it;
+  return tabEnd(it->rx) + (cx - it->cx - 1);
 }
 
 std::size_t Row::rxtocx(int rx) {
-  int cur_rx = 0;
-  std::size_t cx;
-  for (cx = 0; cx < chars.length(); cx++) {
-    if (chars[cx] == '\t') {
-      cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-    }
-    cur_rx++;
-
-    if (cur_rx > rx) {
-      return cx;
+  std::size_t target = std::max(rx, 0);
+  if (auto list = chunks()) {
+    return std::min(list->rxtocx(target), list->length());
+  }
+  std::size_t cx = target;
+  expand();
+  if (tabs()) {
+    auto& stops = extra->tabs->stops;
+    auto it = std::upper_bound(stops.begin(), stops.end(), target,
+      [](std::size_t r, const TabStop& t) { return r < t.rx; });
+    if (it != stops.begin()) {
+      --it;
+      auto end = tabEnd(it->rx);
+      cx = (target < end) ? it->cx : it->cx + 1 + (target - end);
     }
   }
-  return cx;
+  return std::min(cx, chars.length());
 }
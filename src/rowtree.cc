@@ -0,0 +1,416 @@
+#include <iterator>
+#include "rowtree.h"
+
+constexpr const std::size_t ROWTREE_MAX = 64;
+constexpr const std::size_t ROWTREE_MIN = ROWTREE_MAX / 4;
+
+constexpr const std::size_t ROWTREE_STALE = std::size_t(-1);
+
+struct RowTree::Node {
+  explicit Node(bool l) : leaf{l}, size{0}, bytes{ROWTREE_STALE}, rows{},
+  children{} {
+    if (leaf) {
+      rows.reserve(ROWTREE_MAX + 1);
+    } else {
+      children.reserve(ROWTREE_MAX + 1);
+    }
+  }
+
+  Node(const Node& other) : leaf{other.leaf}, size{other.size},
+  bytes{other.bytes}, rows{}, children{} {
+    if (leaf) {
+      rows.reserve(ROWTREE_MAX + 1);
+      rows = other.rows;
+    } else {
+      children.reserve(ROWTREE_MAX + 1);
+      children = other.children;
+    }
+  }
+
+  std::size_t count() const {
+    return leaf ? rows.size() : children.size();
+  }
+
+  Node& operator=(const Node&)=delete;
+
+  bool leaf;
+  std::size_t size;
+  std::size_t bytes;
+  std::vector<Row> rows;
+  std::vector<std::shared_ptr<Node>> children;
+};
+
+using Node = RowTree::Node;
+
+// Nodes shared with a snapshot are copied before they are changed, so a
+// snapshot keeps seeing the rows as they were when it was taken. Anything
+// handed out to be changed has its byte count worked out again when next
+// asked for, so a row reference should not be held across that.
+static Node* own(std::shared_ptr<Node>& node) {
+  if (node.use_count() > 1) {
+    node = std::make_shared<Node>(*node);
+  }
+  node->bytes = ROWTREE_STALE;
+  return node.get();
+}
+
+// The length of the rows under node, a newline after each.
+static std::size_t bytes(Node* node) {
+  if (node->bytes != ROWTREE_STALE) {
+    return node->bytes;
+  }
+  std::size_t n = 0;
+  if (node->leaf) {
+    for (auto& row: node->rows) {
+      n += row.length() + 1;
+    }
+  } else {
+    for (auto& next: node->children) {
+      n += bytes(next.get());
+    }
+  }
+  node->bytes = n;
+  return n;
+}
+
+static Node* child(Node* node, std::size_t k, bool cow) {
+  return cow ? own(node->children[k]) : node->children[k].get();
+}
+
+template<typename T>
+static void moveItems(std::vector<T>& from, std::size_t first, std::size_t last,
+std::vector<T>& to, std::size_t pos) {
+  to.insert(to.begin() + pos, std::make_move_iterator(from.begin() + first),
+    std::make_move_iterator(from.begin() + last));
+  from.erase(from.begin() + first, from.begin() + last);
+}
+
+static std::size_t weight(Node* node, std::size_t first, std::size_t last) {
+  if (node->leaf) {
+    return last - first;
+  }
+  std::size_t w = 0;
+  for (auto j = first; j < last; j++) {
+    w += node->children[j]->size;
+  }
+  return w;
+}
+
+static void shift(Node* from, std::size_t first, std::size_t last, Node* to,
+std::size_t pos) {
+  auto w = weight(from, first, last);
+  if (from->leaf) {
+    moveItems(from->rows, first, last, to->rows, pos);
+  } else {
+    moveItems(from->children, first, last, to->children, pos);
+  }
+  from->size -= w;
+  to->size += w;
+  from->bytes = to->bytes = ROWTREE_STALE;
+}
+
+static std::shared_ptr<Node> split(Node* node, std::size_t at) {
+  auto right = std::make_shared<Node>(node->leaf);
+  auto count = node->count();
+  shift(node, (at == count - 1) ? at : count / 2, count, right.get(), 0);
+  return right;
+}
+
+static std::shared_ptr<Node> insertAt(Node* node, std::size_t at, Row&& row) {
+  node->size++;
+  if (node->leaf) {
+    node->rows.insert(node->rows.begin() + at, std::move(row));
+    return (node->rows.size() > ROWTREE_MAX) ? split(node, at) : nullptr;
+  }
+
+  std::size_t k = 0;
+  while (k + 1 < node->children.size() && at > node->children[k]->size) {
+    at -= node->children[k]->size;
+    k++;
+  }
+
+  auto right = insertAt(child(node, k, true), at, std::move(row));
+  if (!right) {
+    return nullptr;
+  }
+  node->children.insert(node->children.begin() + k + 1, std::move(right));
+  return (node->children.size() > ROWTREE_MAX) ? split(node, k + 1) : nullptr;
+}
+
+static void rebalance(Node* node, std::size_t k) {
+  if (node->children[k]->count() >= ROWTREE_MIN ||
+  node->children.size() == 1) {
+    return;
+  }
+
+  auto l = (k > 0) ? k - 1 : k;
+  Node* a = child(node, l, true);
+  Node* b = child(node, l + 1, true);
+  auto total = a->count() + b->count();
+
+  if (total <= ROWTREE_MAX) {
+    shift(b, 0, b->count(), a, a->count());
+    node->children.erase(node->children.begin() + l + 1);
+  } else if (a->count() < total / 2) {
+    shift(b, 0, total / 2 - a->count(), a, a->count());
+  } else {
+    shift(a, total / 2, a->count(), b, 0);
+  }
+}
+
+static void eraseAt(Node* node, std::size_t at) {
+  node->size--;
+  if (node->leaf) {
+    node->rows.erase(node->rows.begin() + at);
+    return;
+  }
+
+  std::size_t k = 0;
+  while (at >= node->children[k]->size) {
+    at -= node->children[k]->size;
+    k++;
+  }
+
+  eraseAt(child(node, k, true), at);
+  rebalance(node, k);
+}
+
+RowTree::iterator::iterator() : path{}, cow{false} {
+}
+
+RowTree::iterator::iterator(bool c) : path{}, cow{c} {
+}
+
+Row& RowTree::iterator::operator*() const {
+  auto& [leaf, idx] = path.back();
+  return leaf->rows[idx];
+}
+
+Row* RowTree::iterator::operator->() const {
+  return &**this;
+}
+
+RowTree::iterator& RowTree::iterator::operator++() {
+  if (++path.back().second < path.back().first->rows.size()) {
+    return *this;
+  }
+
+  path.pop_back();
+  while (!path.empty()) {
+    auto& [node, k] = path.back();
+    if (++k < node->children.size()) {
+      Node* next = child(node, k, cow);
+      while (!next->leaf) {
+        path.emplace_back(next, 0);
+        next = child(next, 0, cow);
+      }
+      path.emplace_back(next, 0);
+      break;
+    }
+    path.pop_back();
+  }
+
+  return *this;
+}
+
+bool RowTree::iterator::operator==(const iterator& other) const {
+  return path == other.path;
+}
+
+bool RowTree::iterator::operator!=(const iterator& other) const {
+  return path != other.path;
+}
+
+RowTree::const_iterator::const_iterator(iterator&& i) : it{std::move(i)} {
+}
+
+const Row& RowTree::const_iterator::operator*() const {
+  return *it;
+}
+
+const Row* RowTree::const_iterator::operator->() const {
+  return &*it;
+}
+
+RowTree::const_iterator& RowTree::const_iterator::operator++() {
+  ++it;
+  return *this;
+}
+
+bool RowTree::const_iterator::operator==(const const_iterator& other) const {
+  return it == other.it;
+}
+
+bool RowTree::const_iterator::operator!=(const const_iterator& other) const {
+  return it != other.it;
+}
+
+RowTree::RowTree() : root{std::make_shared<Node>(true)} {
+}
+
+RowTree::RowTree(const RowTree& other) : root{other.root} {
+}
+
+RowTree::~RowTree() {
+}
+
+Row& RowTree::operator[](std::size_t at) {
+  Node* node = own(root);
+  while (!node->leaf) {
+    std::size_t k = 0;
+    while (at >= node->children[k]->size) {
+      at -= node->children[k]->size;
+      k++;
+    }
+    node = child(node, k, true);
+  }
+  return node->rows[at];
+}
+
+const Row& RowTree::operator[](std::size_t at) const {
+  return *this->at(at);
+}
+
+RowTree::iterator RowTree::at(std::size_t at) {
+  iterator it(true);
+  if (at >= root->size) {
+    return it;
+  }
+
+  Node* node = own(root);
+  while (!node->leaf) {
+    std::size_t k = 0;
+    while (at >= node->children[k]->size) {
+      at -= node->children[k]->size;
+      k++;
+    }
+    it.path.emplace_back(node, k);
+    node = child(node, k, true);
+  }
+  it.path.emplace_back(node, at);
+
+  return it;
+}
+
+RowTree::const_iterator RowTree::at(std::size_t at) const {
+  iterator it;
+  if (at >= root->size) {
+    return const_iterator(std::move(it));
+  }
+
+  Node* node = root.get();
+  while (!node->leaf) {
+    std::size_t k = 0;
+    while (at >= node->children[k]->size) {
+      at -= node->children[k]->size;
+      k++;
+    }
+    it.path.emplace_back(node, k);
+    node = node->children[k].get();
+  }
+  it.path.emplace_back(node, at);
+
+  return const_iterator(std::move(it));
+}
+
+RowTree::iterator RowTree::begin() {
+  return at(0);
+}
+
+RowTree::const_iterator RowTree::begin() const {
+  return at(0);
+}
+
+void RowTree::clear() {
+  root = std::make_shared<Node>(true);
+}
+
+RowTree::iterator RowTree::end() {
+  return iterator(true);
+}
+
+RowTree::const_iterator RowTree::end() const {
+  return const_iterator(iterator());
+}
+
+void RowTree::erase(std::size_t at) {
+  if (at >= root->size) {
+    return;
+  }
+
+  Node* node = own(root);
+  eraseAt(node, at);
+  if (!node->leaf && node->children.size() == 1) {
+    root = node->children[0];
+  }
+}
+
+// The line the byte at offset is on, or size() if it is past the end.
+std::size_t RowTree::lineAt(std::size_t offset) const {
+  Node* node = root.get();
+  if (offset >= bytes(node)) {
+    return node->size;
+  }
+
+  std::size_t line = 0;
+  while (!node->leaf) {
+    std::size_t k = 0;
+    while (offset >= bytes(node->children[k].get())) {
+      offset -= bytes(node->children[k].get());
+      line += node->children[k]->size;
+      k++;
+    }
+    node = node->children[k].get();
+  }
+  for (auto& row: node->rows) {
+    if (offset <= row.length()) {
+      break;
+    }
+    offset -= row.length() + 1;
+    line++;
+  }
+  return line;
+}
+
+// The offset line starts at, counting a newline after every row before
+// it, as the file would be saved.
+std::size_t RowTree::lineOffset(std::size_t line) const {
+  Node* node = root.get();
+  if (line >= node->size) {
+    return bytes(node);
+  }
+
+  std::size_t offset = 0;
+  while (!node->leaf) {
+    std::size_t k = 0;
+    while (line >= node->children[k]->size) {
+      line -= node->children[k]->size;
+      offset += bytes(node->children[k].get());
+      k++;
+    }
+    node = node->children[k].get();
+  }
+  for (std::size_t j = 0; j < line; j++) {
+    offset += node->rows[j].length() + 1;
+  }
+  return offset;
+}
+
+void RowTree::insert(std::size_t at, Row&& row) {
+  if (at > root->size) {
+    return;
+  }
+
+  auto right = insertAt(own(root), at, std::move(row));
+  if (right) {
+    auto node = std::make_shared<Node>(false);
+    node->size = root->size + right->size;
+    node->children.push_back(std::move(root));
+    node->children.push_back(std::move(right));
+    root = std::move(node);
+  }
+}
+
+std::size_t RowTree::size() const {
+  return root->size;
+}
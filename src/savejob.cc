@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "savejob.h"
+
+namespace fs = std::filesystem;
+
+constexpr const std::size_t SAVE_BATCH = IOV_MAX / 2;
+
+SaveJob::SaveJob(const RowTree& tree, const fs::path& filename) : rows{tree},
+target{filename}, mode{0}, rows_written{0}, bytes_written{0},
+finished{false}, error{}, thread{} {
+  std::error_code ec;
+  if (fs::is_symlink(target, ec)) {
+    target = fs::canonical(target, ec);
+  }
+
+  struct stat st;
+  if (stat(target.c_str(), &st) == 0) {
+    mode = st.st_mode & 07777;
+  } else {
+    mode_t mask = umask(0);
+    umask(mask);
+    mode = 0666 & ~mask;
+  }
+
+  thread = std::thread(&SaveJob::run, this);
+}
+
+SaveJob::~SaveJob() {
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool SaveJob::done() const {
+  return finished.load(std::memory_order_acquire);
+}
+
+void SaveJob::fail(const char* what) {
+  error = std::string(what) + ": " + strerror(errno);
+}
+
+bool SaveJob::flush(int fd, struct iovec* iov, std::size_t count) {
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, std::min<std::size_t>(count, IOV_MAX));
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("write");
+      return false;
+    }
+    bytes_written += n;
+    while (count > 0 && static_cast<std::size_t>(n) >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+int SaveJob::progress() const {
+  auto total = rows.size();
+  return total ? rows_written * 100 / total : 100;
+}
+
+void SaveJob::run() {
+  auto dir = target.parent_path();
+  std::string tmp = dir / ("." + target.filename().native() + ".XXXXXX");
+  int fd = mkstemp(tmp.data());
+  if (fd == -1) {
+    fail("mkstemp");
+    finished.store(true, std::memory_order_release);
+    return;
+  }
+
+  bool ok = writeRows(fd);
+  if (ok && fsync(fd) == -1) {
+    fail("fsync");
+    ok = false;
+  }
+  if (close(fd) == -1 && ok) {
+    fail("close");
+    ok = false;
+  }
+  if (ok && rename(tmp.c_str(), target.c_str()) == -1) {
+    fail("rename");
+    ok = false;
+  }
+
+  if (ok) {
+    int dfd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd != -1) {
+      fsync(dfd);
+      close(dfd);
+    }
+  } else {
+    unlink(tmp.c_str());
+  }
+  finished.store(true, std::memory_order_release);
+}
+
+bool SaveJob::writeRows(int fd) {
+  if (fchmod(fd, mode) == -1) {
+    fail("fchmod");
+    return false;
+  }
+
+  static char newline = '\n';
+  std::vector<struct iovec> iov;
+  iov.reserve(SAVE_BATCH * 2);
+  std::size_t pending = 0;
+  for (auto it = rows.begin(); it != rows.end(); ++it) {
+    if (it->chunks()) {
+      for (auto& chunk: it->chunks()->chunks) {
+        iov.push_back({ const_cast<char*>(chunk.chars.data()),
+          chunk.chars.length() });
+      }
+    } else {
+      iov.push_back({ const_cast<char*>(it->chars.data()),
+        it->chars.length() });
+    }
+    iov.push_back({ &newline, 1 });
+    if (++pending == SAVE_BATCH || iov.size() >= SAVE_BATCH * 2) {
+      if (!flush(fd, iov.data(), iov.size())) {
+        return false;
+      }
+      rows_written += pending;
+      pending = 0;
+      iov.clear();
+    }
+  }
+  if (!flush(fd, iov.data(), iov.size())) {
+    return false;
+  }
+  rows_written += pending;
+  return true;
+}
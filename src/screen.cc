@@ -1,16 +1,169 @@
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <sstream>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <sys/types.h>
+#include <string_view>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "profile.h"
 #include "screen.h"
 
-Screen::Screen() : cols{0}, rows{0}, orig_termios{}, ab{} {
+constexpr const Cell BLANK = { ' ', FGColor::RESET, false };
+
+constexpr const int SCREEN_SKIP_MAX = 4;
+
+constexpr const std::size_t SCREEN_INPUT_SIZE = 1 << 16;
+
+constexpr const std::size_t SCREEN_SEQ_MAX = 16;
+
+constexpr const int SCREEN_PASTE_TIMEOUT = 1000;
+
+// Terminals that support it hold a frame between these and show it all at
+// once. The rest ignore them.
+constexpr const std::string_view SCREEN_SYNC_BEGIN = "\x1b[?2026h";
+
+constexpr const std::string_view SCREEN_SYNC_END = "\x1b[?2026l";
+
+static_assert(sizeof(Cell) == 3, "rows are compared with memcmp");
+
+bool Cell::operator==(const Cell& other) const {
+  return ch == other.ch && fg == other.fg && inverse == other.inverse;
+}
+
+bool Cell::operator!=(const Cell& other) const {
+  return !(*this == other);
+}
+
+static inline std::size_t findControl(const char* s, std::size_t len) {
+  std::size_t j = 0;
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i del = _mm_set1_epi8(127);
+  const __m128i zero = _mm_setzero_si128();
+  for (; j + 16 <= len; j += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + j));
+    __m128i low = _mm_andnot_si128(_mm_cmplt_epi8(block, zero),
+      _mm_cmplt_epi8(block, space));
+    int mask = _mm_movemask_epi8(_mm_or_si128(low,
+      _mm_cmpeq_epi8(block, del)));
+    if (mask) {
+      return j + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; j < len; j++) {
+    unsigned char c = s[j];
+    if (c < ' ' || c == 127) {
+      return j;
+    }
+  }
+  return len;
+}
+
+static void appendMove(Screen& screen, int x, int y) {
+  if (screen.term_x == x && screen.term_y == y) {
+    return;
+  }
+
+  char buf[32];
+  int len;
+  int gap = x - screen.term_x;
+  if (screen.term_y == y && gap > 0 && screen.term_x < screen.cols) {
+    auto first = screen.front.begin() + y * screen.cols + screen.term_x;
+    if (gap <= SCREEN_SKIP_MAX && std::all_of(first, first + gap,
+    [&screen](const Cell& cell) {
+      return cell.fg == screen.term_pen.fg &&
+        cell.inverse == screen.term_pen.inverse;
+    })) {
+      std::for_each(first, first + gap, [&screen](const Cell& cell) {
+        screen.ab += cell.ch;
+      });
+      screen.term_x = x;
+      return;
+    }
+    len = snprintf(buf, sizeof(buf), "\x1b[%dC", gap);
+  } else if (x == 0 && y == 0) {
+    len = snprintf(buf, sizeof(buf), "\x1b[H");
+  } else {
+    len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+  }
+  screen.ab.append(buf, len);
+  screen.term_x = x;
+  screen.term_y = y;
+}
+
+constexpr const int SCREEN_PENS = 20;
+
+static inline int penIndex(FGColor fg, bool inverse) {
+  return (static_cast<int>(fg) - static_cast<int>(FGColor::BLACK)) * 2 +
+    inverse;
+}
+
+// The escape that takes the terminal from one pen to another, formatted once
+// for every pair so a frame only has to copy them.
+static std::string penEscape(int from, int to) {
+  FGColor from_fg = static_cast<FGColor>(from / 2 + 30);
+  FGColor to_fg = static_cast<FGColor>(to / 2 + 30);
+  bool from_inverse = from % 2, to_inverse = to % 2;
+  if (from == to) {
+    return "";
+  }
+
+  std::string seq = "\x1b[";
+  const char* sep = "";
+  if (from_inverse && !to_inverse) {
+    seq += '0';
+    from_fg = FGColor::RESET;
+    from_inverse = false;
+    sep = ";";
+  }
+  if (to_inverse && !from_inverse) {
+    seq.append(sep).append("7");
+    sep = ";";
+  }
+  if (to_fg != from_fg) {
+    seq.append(sep).append(std::to_string(static_cast<int>(to_fg)));
+  }
+  return seq + 'm';
+}
+
+static void appendPen(Screen& screen, const Cell& cell) {
+  static const std::vector<std::string> escapes = [] {
+    std::vector<std::string> table;
+    for (auto from = 0; from < SCREEN_PENS; from++) {
+      for (auto to = 0; to < SCREEN_PENS; to++) {
+        table.push_back(penEscape(from, to));
+      }
+    }
+    return table;
+  }();
+
+  Cell& term = screen.term_pen;
+  if (cell.fg == term.fg && cell.inverse == term.inverse) {
+    return;
+  }
+  screen.ab.append(escapes[penIndex(term.fg, term.inverse) * SCREEN_PENS +
+    penIndex(cell.fg, cell.inverse)]);
+  term.fg = cell.fg;
+  term.inverse = cell.inverse;
+}
+
+Screen::Screen() : Screen(std::make_unique<TTYTerminal>()) {
+}
+
+Screen::Screen(std::unique_ptr<Terminal> t) : term{std::move(t)}, cols{0},
+rows{0}, ab{}, front{}, back{},
+invalid{true}, x{0}, y{0}, pen{BLANK}, cursor_visible{true}, term_x{0},
+term_y{0}, term_pen{BLANK}, term_cursor_visible{true}, frame_bytes{0},
+total_bytes{0}, input(SCREEN_INPUT_SIZE), in_head{0}, in_tail{0},
+resized{false}, paste{} {
   if (!getWindowSize()) {
     die("getWindowSize");
   }
   rows -= 2;
   enableRawMode();
+  resize();
 }
 
 Screen::~Screen() {
@@ -18,19 +171,17 @@ Screen::~Screen() {
 }
 
 bool Screen::clear() {
-  if (write(STDOUT_FILENO, "\x1b[2J", 4) == -1) {
-    return false;
-  }
+  invalid = true;
 
-  if (write(STDOUT_FILENO, "\x1b[H", 3) == -1) {
-    return false;
-  }
-
-  return true;
+  return term->write("\x1b[2J", 4) && term->write("\x1b[H", 3);
 }
 
 void Screen::clearToEOL() {
-  ab.append("\x1b[K", 3);
+  if (y < 0 || y >= rows + 2 || x >= cols) {
+    return;
+  }
+  auto first = back.begin() + y * cols;
+  std::fill(first + std::max(x, 0), first + cols, BLANK);
 }
 
 void Screen::die(const char *s) {
@@ -44,176 +195,368 @@ void Screen::die(const char *s) {
 }
 
 void Screen::disableRawMode() {
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) {
-    die("tcsetattr");
+  if (!term->disableRawMode()) {
+    die("disableRawMode");
   }
 }
 
 void Screen::enableRawMode() {
-  if (tcgetattr(STDIN_FILENO, &orig_termios) == -1) {
-    die("tcgetattr");
+  if (!term->enableRawMode()) {
+    die("enableRawMode");
   }
+}
 
-  struct termios raw = orig_termios;
-  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
-  raw.c_oflag &= ~(OPOST);
-  raw.c_cflag |= (CS8);
-  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
-  raw.c_cc[VMIN] = 0;
-  raw.c_cc[VTIME] = 1;
+bool Screen::getWindowSize() {
+  return term->getWindowSize(rows, cols);
+}
+
+void Screen::hideCursor() {
+  cursor_visible = false;
+}
 
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
-    die("tcsetattr");
+// Whether a key is already waiting, without blocking.
+bool Screen::inputPending() {
+  return wantInput(1, 0);
+}
+
+void Screen::inverse(bool on) {
+  pen.inverse = on;
+  if (!on) {
+    pen.fg = FGColor::RESET;
   }
 }
 
-bool Screen::getCursorPosition() {
+void Screen::moveCursor(std::size_t row, std::size_t col) {
+  if (row == 0 && col == 0) {
+    y = 0;
+    x = 0;
+  } else {
+    y = row - 1;
+    x = col - 1;
+  }
+}
 
-  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) {
-    return false;
+void::Screen::print(const char* s, std::size_t len) {
+  for (std::size_t j = 0; j < len; j++) {
+    if (s[j] == '\r') {
+      x = 0;
+    } else if (s[j] == '\n') {
+      y++;
+    } else {
+      printChar(s[j]);
+    }
   }
+}
 
-  char buf[32];
-  unsigned int i = 0;
+void::Screen::printChar(const char c) {
+  if (y >= 0 && y < rows + 2 && x >= 0 && x < cols) {
+    back[y * cols + x] = { c, pen.fg, pen.inverse };
+  }
+  x++;
+}
 
-  while (i < sizeof(buf) - 1) {
-    if (read(STDIN_FILENO, &buf[i], 1) != 1) {
-      break;
+void Screen::printSpan(const char* s, std::size_t len, FGColor fg) {
+  if (y < 0 || y >= rows + 2 || x >= cols) {
+    x += len;
+    return;
+  }
+
+  std::size_t skip = (x < 0) ? std::min<std::size_t>(len, -x) : 0;
+  std::size_t visible = std::min<std::size_t>(len - skip, cols - (x + skip));
+  Cell* out = &back[y * cols + x + skip];
+  s += skip;
+  for (std::size_t j = 0; j < visible; ) {
+    auto ctrl = j + findControl(s + j, visible - j);
+    for (; j < ctrl; j++) {
+      out[j] = { s[j], fg, false };
     }
-    if (buf[i] == 'R') {
-      break;
+    if (j < visible) {
+      char sym = (s[j] >= 0 && s[j] <= 26) ? '@' + s[j] : '?';
+      out[j++] = { sym, fg, true };
     }
-    i++;
   }
-  buf[i] = '\0';
+  x += len;
+}
 
-  if (buf[0] != '\x1b' || buf[1] != '[') {
-    return false;
+// Waits up to timeout milliseconds for input and reads what there is. A
+// resize seen on the way is dealt with here and noted for readKey.
+bool Screen::fillInput(int timeout) {
+  auto used = in_tail - in_head;
+  if (used == input.size()) {
+    return true;
+  }
+
+  int ready = term->poll(timeout);
+  if (ready == -1) {
+    die("poll");
   }
-  if (sscanf(&buf[2], "%d;%d", &rows, &cols) != 2) {
+  if (ready & Terminal::RESIZED) {
+    if (getWindowSize()) {
+      rows -= 2;
+      resize();
+    }
+    resized = true;
+  }
+  if (!(ready & Terminal::READABLE)) {
     return false;
   }
 
+  auto at = in_tail & (input.size() - 1);
+  auto space = std::min(input.size() - used, input.size() - at);
+  ssize_t nread = term->read(&input[at], space);
+  if (nread == -1 && errno != EAGAIN) {
+    die("read");
+  }
+  if (nread <= 0) {
+    return false;
+  }
+  in_tail += nread;
   return true;
 }
 
-bool Screen::getWindowSize() {
-  struct winsize ws;
+// Blocks for up to timeout milliseconds, or until a key arrives if it is
+// negative. Returns TIMEOUT if none did, or RESIZE if the window changed.
+int Screen::readKey(int timeout) {
+  resized = false;
+  {
+    PROFILE(Phase::WAIT);
+    while (!wantInput(1, timeout)) {
+      if (resized || timeout >= 0) {
+        return resized ? RESIZE : TIMEOUT;
+      }
+    }
+  }
 
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-    if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12) {
-      return false;
+  PROFILE(Phase::INPUT);
+  char c = takeInput();
+  if (c != '\x1b') {
+    return c;
+  }
+
+  if (!wantInput(1)) {
+    return '\x1b';
+  }
+
+  if (input[in_head & (input.size() - 1)] == 'O') {
+    takeInput();
+    if (!wantInput(1)) {
+      return '\x1b';
     }
-    return getCursorPosition();
-  } else {
-    cols = ws.ws_col;
-    rows = ws.ws_row;
-    return true;
+    switch (takeInput()) {
+      case 'H': return HOME_KEY;
+      case 'F': return END_KEY;
+    }
+    return '\x1b';
   }
-}
 
-void Screen::hideCursor() {
-  ab.append("\x1b[?25l", 6);
-}
+  if (input[in_head & (input.size() - 1)] != '[') {
+    return '\x1b';
+  }
+  takeInput();
 
-void Screen::inverse(bool on) {
-  if (on) {
-    ab.append("\x1b[7m", 4);
-  } else {
-    ab.append("\x1b[m", 3);
+  std::string seq;
+  while (true) {
+    if (!wantInput(1)) {
+      return '\x1b';
+    }
+    c = takeInput();
+    if ((c < '0' || c > '9') && c != ';') {
+      break;
+    }
+    if (seq.length() == SCREEN_SEQ_MAX) {
+      return '\x1b';
+    }
+    seq += c;
   }
-}
 
-void Screen::moveCursor(std::size_t row, std::size_t col) {
-    if (row == 0 && col == 0) {
-        ab.append("\x1b[H", 3);
-    } else {
-      char buf[32];
-      snprintf(buf, sizeof(buf), "\x1b[%ld;%ldH", row, col);
-      ab.append(buf, strlen(buf));
+  if (c == '~') {
+    if (seq == "200") {
+      readPaste();
+      return PASTE;
     }
-}
+    if (seq.length() == 1) {
+      switch (seq[0]) {
+        case '1': return HOME_KEY;
+        case '3': return DEL_KEY;
+        case '4': return END_KEY;
+        case '5': return PAGE_UP;
+        case '6': return PAGE_DOWN;
+        case '7': return HOME_KEY;
+        case '8': return END_KEY;
+      }
+    }
+  } else if (seq.empty()) {
+    switch (c) {
+      case 'A': return ARROW_UP;
+      case 'B': return ARROW_DOWN;
+      case 'C': return ARROW_RIGHT;
+      case 'D': return ARROW_LEFT;
+      case 'H': return HOME_KEY;
+      case 'F': return END_KEY;
+    }
+  }
 
-void::Screen::print(const char* s, std::size_t len) {
-  ab.append(s, len);
+  return '\x1b';
 }
 
-void::Screen::printChar(const char c) {
-  ab.append(1, c);
-}
+// Collects a bracketed paste up to its end marker. A paste whose end never
+// comes, because the connection dropped or the terminal cut it short, ends
+// after SCREEN_PASTE_TIMEOUT ms without input with what has arrived.
+void Screen::readPaste() {
+  constexpr std::string_view end = "\x1b[201~";
+
+  paste.clear();
+  while (true) {
+    if (!wantInput(1, SCREEN_PASTE_TIMEOUT)) {
+      return;
+    }
 
-int Screen::readKey() {
-  int nread;
-  char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN) {
-      die("read");
+    auto at = in_head & (input.size() - 1);
+    auto span = std::min(in_tail - in_head, input.size() - at);
+    auto esc = static_cast<const char*>(memchr(&input[at], '\x1b', span));
+    if (!esc) {
+      paste.append(&input[at], span);
+      in_head += span;
+      continue;
     }
+
+    auto len = esc - &input[at];
+    paste.append(&input[at], len);
+    in_head += len;
+
+    std::size_t matched = 0;
+    while (matched < end.length() && wantInput(matched + 1) &&
+    input[(in_head + matched) & (input.size() - 1)] == end[matched]) {
+      matched++;
+    }
+    if (matched == end.length()) {
+      in_head += matched;
+      return;
+    }
+    paste += takeInput();
   }
+}
 
-  if (c == '\x1b') {
-    char seq[3];
+void Screen::refresh() {
+  PROFILE(Phase::WRITE);
+  ab.assign(SCREEN_SYNC_BEGIN);
+  if (invalid) {
+    ab.append("\x1b[?25l\x1b[m\x1b[H\x1b[2J");
+    std::fill(front.begin(), front.end(), BLANK);
+    term_x = 0;
+    term_y = 0;
+    term_pen = BLANK;
+    term_cursor_visible = false;
+    invalid = false;
+  }
 
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) {
-      return '\x1b';
+  auto rowChanged = [this](int row) {
+    auto first = row * cols;
+    return memcmp(&back[first], &front[first], cols * sizeof(Cell)) != 0;
+  };
+  int changed_rows = 0;
+  for (auto row = 0; row < rows + 2 && changed_rows < 2; row++) {
+    changed_rows += rowChanged(row);
+  }
+  if (changed_rows > 1 && term_cursor_visible) {
+    ab.append("\x1b[?25l");
+    term_cursor_visible = false;
+  }
+
+  // Cells that share a pen go out as one run. A run carries on over up to
+  // SCREEN_SKIP_MAX unchanged cells rather than breaking for a move.
+  for (auto row = 0; row < rows + 2; row++) {
+    if (!rowChanged(row)) {
+      continue;
     }
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) {
-      return '\x1b';
+    const Cell* cells = &back[row * cols];
+    const Cell* old = &front[row * cols];
+    auto blank_from = cols;
+    while (blank_from > 0 && cells[blank_from - 1] == BLANK) {
+      blank_from--;
     }
 
-    if (seq[0] == '[') {
-      if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1) {
-          return '\x1b';
-        }
-        if (seq[2] == '~') {
-          switch (seq[1]) {
-            case '1': return HOME_KEY;
-            case '3': return DEL_KEY;
-            case '4': return END_KEY;
-            case '5': return PAGE_UP;
-            case '6': return PAGE_DOWN;
-            case '7': return HOME_KEY;
-            case '8': return END_KEY;
-          }
+    for (auto col = 0; col < cols; ) {
+      if (cells[col] == old[col]) {
+        col++;
+        continue;
+      }
+      appendMove(*this, col, row);
+      if (col >= blank_from) {
+        appendPen(*this, BLANK);
+        ab.append("\x1b[K");
+        break;
+      }
+      appendPen(*this, cells[col]);
+      auto end = col + 1;
+      for (auto k = end; k < blank_from && k - end <= SCREEN_SKIP_MAX; k++) {
+        if (cells[k].fg != term_pen.fg ||
+        cells[k].inverse != term_pen.inverse) {
+          break;
         }
-      } else {
-        switch (seq[1]) {
-          case 'A': return ARROW_UP;
-          case 'B': return ARROW_DOWN;
-          case 'C': return ARROW_RIGHT;
-          case 'D': return ARROW_LEFT;
-          case 'H': return HOME_KEY;
-          case 'F': return END_KEY;
+        if (cells[k] != old[k]) {
+          end = k + 1;
         }
       }
-    } else if (seq[0] == 'O') {
-      switch (seq[1]) {
-        case 'H': return HOME_KEY;
-        case 'F': return END_KEY;
-      }
+      auto at = ab.size();
+      ab.resize(at + (end - col));
+      std::transform(cells + col, cells + end, &ab[at],
+        [](const Cell& cell) { return cell.ch; });
+      term_x = end;
+      col = end;
     }
+    memcpy(&front[row * cols], cells, cols * sizeof(Cell));
+  }
 
-    return '\x1b';
-  } else {
-    return c;
+  if (cursor_visible) {
+    appendMove(*this, std::clamp(x, 0, cols - 1),
+      std::clamp(y, 0, rows + 1));
+    if (!term_cursor_visible) {
+      ab.append("\x1b[?25h");
+      term_cursor_visible = true;
+    }
+  } else if (term_cursor_visible) {
+    ab.append("\x1b[?25l");
+    term_cursor_visible = false;
   }
-}
 
-void Screen::refresh() {
-  if (write(STDOUT_FILENO, ab.data(), ab.size()) == -1) {
+  if (ab.size() == SCREEN_SYNC_BEGIN.length()) {
+    ab.clear();
+  } else {
+    ab.append(SCREEN_SYNC_END);
+  }
+  if (!term->present(ab.data(), ab.size())) {
     die("write");
   }
+  frame_bytes = ab.size();
+  total_bytes += frame_bytes;
+  PROFILE_BYTES(frame_bytes);
   ab.clear();
 }
 
+void Screen::resize() {
+  front.assign((rows + 2) * cols, BLANK);
+  back.assign((rows + 2) * cols, BLANK);
+  invalid = true;
+}
+
 void Screen::setFGColor(FGColor color) {
-  char buf[16];
-  int clen =
-    snprintf(buf, sizeof(buf), "\x1b[%dm", static_cast<int>(color));
-  ab.append(buf, clen);
+  pen.fg = color;
 }
 
 void Screen::showCursor() {
-  ab.append("\x1b[?25h", 6);
+  cursor_visible = true;
+}
+
+char Screen::takeInput() {
+  return input[in_head++ & (input.size() - 1)];
+}
+
+bool Screen::wantInput(std::size_t n, int timeout) {
+  while (in_tail - in_head < n) {
+    if (!fillInput(timeout)) {
+      return false;
+    }
+  }
+  return true;
 }
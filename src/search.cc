@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SEARCH_AVX2 1
+#endif
+#include "search.h"
+
+constexpr const std::size_t SEARCH_HORSPOOL_MIN = 32;
+
+using Kernel = std::size_t (*)(const char*, std::size_t, const char*,
+  std::size_t, std::size_t);
+
+static std::size_t findScalar(const char* h, std::size_t size, const char* n,
+std::size_t len, std::size_t from) {
+  while (from + len <= size) {
+    auto p = static_cast<const char*>(memchr(h + from, n[0],
+      size - len + 1 - from));
+    if (!p) {
+      break;
+    }
+    from = p - h;
+    if (!memcmp(p + 1, n + 1, len - 1)) {
+      return from;
+    }
+    from++;
+  }
+  return std::string_view::npos;
+}
+
+#ifdef __SSE2__
+static std::size_t findSSE2(const char* h, std::size_t size, const char* n,
+std::size_t len, std::size_t from) {
+  const __m128i first = _mm_set1_epi8(n[0]);
+  const __m128i last = _mm_set1_epi8(n[len - 1]);
+
+  for (; from + len - 1 + 16 <= size; from += 16) {
+    __m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + from));
+    __m128i bl = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(h + from + len - 1));
+    unsigned mask = _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+    while (mask) {
+      auto bit = __builtin_ctz(mask);
+      if (!memcmp(h + from + bit + 1, n + 1, len - 2)) {
+        return from + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return findScalar(h, size, n, len, from);
+}
+#endif
+
+#ifdef SEARCH_AVX2
+__attribute__((target("avx2")))
+static std::size_t findAVX2(const char* h, std::size_t size, const char* n,
+std::size_t len, std::size_t from) {
+  const __m256i first = _mm256_set1_epi8(n[0]);
+  const __m256i last = _mm256_set1_epi8(n[len - 1]);
+
+  for (; from + len - 1 + 32 <= size; from += 32) {
+    __m256i bf =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + from));
+    __m256i bl = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(h + from + len - 1));
+    std::uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+      _mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+    while (mask) {
+      auto bit = __builtin_ctz(mask);
+      if (!memcmp(h + from + bit + 1, n + 1, len - 2)) {
+        return from + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return findScalar(h, size, n, len, from);
+}
+#endif
+
+static std::size_t findHorspool(const char* h, std::size_t size, const char* n,
+std::size_t len, std::size_t from) {
+  std::size_t skip[256];
+  for (auto& s: skip) {
+    s = len;
+  }
+  for (std::size_t j = 0; j + 1 < len; j++) {
+    skip[static_cast<unsigned char>(n[j])] = len - 1 - j;
+  }
+
+  while (from + len <= size) {
+    unsigned char c = h[from + len - 1];
+    if (c == static_cast<unsigned char>(n[len - 1]) &&
+    !memcmp(h + from, n, len - 1)) {
+      return from;
+    }
+    from += skip[c];
+  }
+  return std::string_view::npos;
+}
+
+static Kernel selectKernel() {
+#ifdef SEARCH_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return findAVX2;
+  }
+#endif
+#ifdef __SSE2__
+  return findSSE2;
+#else
+  return findScalar;
+#endif
+}
+
+std::size_t findText(std::string_view haystack, std::string_view needle,
+std::size_t from) {
+  static const Kernel kernel = selectKernel();
+
+  auto size = haystack.length();
+  auto len = needle.length();
+  if (from > size || len > size - from) {
+    return std::string_view::npos;
+  }
+  if (len == 0) {
+    return from;
+  }
+  if (len == 1) {
+    auto p = static_cast<const char*>(
+      memchr(haystack.data() + from, needle[0], size - from));
+    return p ? p - haystack.data() : std::string_view::npos;
+  }
+  if (len >= SEARCH_HORSPOOL_MIN) {
+    return findHorspool(haystack.data(), size, needle.data(), len, from);
+  }
+  return kernel(haystack.data(), size, needle.data(), len, from);
+}
+
+// The last match that starts before before. Candidates for the first
+// byte are found going back from there with memrchr, so every byte is
+// looked at once however many matches come after.
+std::size_t rfindText(std::string_view haystack, std::string_view needle,
+std::size_t before) {
+  auto size = haystack.length();
+  auto len = needle.length();
+  if (before == 0 || len > size) {
+    return std::string_view::npos;
+  }
+  auto end = std::min(before, size - len + 1);
+  if (len == 0) {
+    return end - 1;
+  }
+
+  const char* h = haystack.data();
+  while (end > 0) {
+    auto p = static_cast<const char*>(memrchr(h, needle[0], end));
+    if (!p) {
+      break;
+    }
+    if (!memcmp(p + 1, needle.data() + 1, len - 1)) {
+      return p - h;
+    }
+    end = p - h;
+  }
+  return std::string_view::npos;
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <sys/stat.h>
+#include "highlighter.h"
+#include "syntaxdb.h"
+
+constexpr const char* SYNTAX_EXTENSION = ".syntax";
+
+constexpr const char* SYNTAX_CACHE_MAGIC = "kilo-syntax-cache 1\n";
+
+// Reads back what CacheWriter wrote, failing for good at the first field
+// that runs past the end.
+struct CacheReader {
+  explicit CacheReader(std::string&& data) : bytes{std::move(data)}, at{0},
+  ok{true} {
+  }
+
+  bool take(void* out, std::size_t n) {
+    ok = ok && n <= bytes.size() - at;
+    if (ok) {
+      memcpy(out, bytes.data() + at, n);
+      at += n;
+    }
+    return ok;
+  }
+
+  std::uint64_t number() {
+    std::uint64_t n = 0;
+    take(&n, sizeof(n));
+    return n;
+  }
+
+  std::string string() {
+    auto n = number();
+    ok = ok && n <= bytes.size() - at;
+    if (!ok) {
+      return std::string();
+    }
+    at += n;
+    return bytes.substr(at - n, n);
+  }
+
+  std::vector<std::string> strings() {
+    std::vector<std::string> list(std::min<std::uint64_t>(number(),
+      bytes.size() - at));
+    for (auto& s: list) {
+      s = string();
+    }
+    return list;
+  }
+
+  std::string bytes;
+  std::size_t at;
+  bool ok;
+};
+
+struct CacheWriter {
+  CacheWriter() : bytes{} {
+  }
+
+  void put(const void* in, std::size_t n) {
+    bytes.append(static_cast<const char*>(in), n);
+  }
+
+  void number(std::uint64_t n) {
+    put(&n, sizeof(n));
+  }
+
+  void string(const std::string& s) {
+    number(s.length());
+    bytes += s;
+  }
+
+  void strings(const std::vector<std::string>& list) {
+    number(list.size());
+    for (auto& s: list) {
+      string(s);
+    }
+  }
+
+  std::string bytes;
+};
+
+// Reads the syntaxes kept in cache into read if it was written for key
+// and reads back whole, with keyword tables find can trust.
+static bool readCache(const std::filesystem::path& cache,
+const std::string& key, std::vector<EditorSyntax>& read) {
+  std::ifstream in(cache, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  std::string bytes(in.tellg(), '\0');
+  in.seekg(0);
+  if (!in.read(bytes.data(), bytes.size())) {
+    return false;
+  }
+  CacheReader reader(std::move(bytes));
+  if (reader.string() != key) {
+    return false;
+  }
+
+  read.resize(std::min<std::uint64_t>(reader.number(), reader.bytes.size()),
+    EditorSyntax{ {}, {}, {}, {}, {}, 0, {}, highlightGeneric });
+  for (auto& syntax: read) {
+    syntax.filetype = reader.string();
+    syntax.filematch = reader.strings();
+    syntax.singleline_comment_start = reader.string();
+    syntax.multiline_comment_start = reader.string();
+    syntax.multiline_comment_end = reader.string();
+    syntax.flags = reader.number();
+
+    auto& table = syntax.keyword_table;
+    table.text = reader.string();
+    table.words.resize(std::min<std::uint64_t>(reader.number(),
+      reader.bytes.size()));
+    reader.take(table.words.data(), table.words.size() * sizeof(Keyword));
+    table.slots.resize(std::min<std::uint64_t>(reader.number(),
+      reader.bytes.size()));
+    reader.take(table.slots.data(), table.slots.size() * sizeof(int));
+    table.min_length = reader.number();
+    table.max_length = reader.number();
+    reader.take(table.first_bytes, sizeof(table.first_bytes));
+    if (!reader.ok || !table.valid()) {
+      return false;
+    }
+  }
+  return reader.ok && reader.at == reader.bytes.size();
+}
+
+// Writes syntaxes to cache under key, through a temporary file so an
+// editor starting meanwhile never reads half of it.
+static bool writeCache(const std::filesystem::path& cache,
+const std::string& key, const std::vector<EditorSyntax>& syntaxes) {
+  CacheWriter writer;
+  writer.string(key);
+  writer.number(syntaxes.size());
+  for (auto& syntax: syntaxes) {
+    writer.string(syntax.filetype);
+    writer.strings(syntax.filematch);
+    writer.string(syntax.singleline_comment_start);
+    writer.string(syntax.multiline_comment_start);
+    writer.string(syntax.multiline_comment_end);
+    writer.number(syntax.flags);
+
+    auto& table = syntax.keyword_table;
+    writer.string(table.text);
+    writer.number(table.words.size());
+    writer.put(table.words.data(), table.words.size() * sizeof(Keyword));
+    writer.number(table.slots.size());
+    writer.put(table.slots.data(), table.slots.size() * sizeof(int));
+    writer.number(table.min_length);
+    writer.number(table.max_length);
+    writer.put(table.first_bytes, sizeof(table.first_bytes));
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(cache.parent_path(), ec);
+  auto tmp = cache;
+  tmp += ".tmp";
+  std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+  out.write(writer.bytes.data(), writer.bytes.size());
+  out.close();
+  if (!out) {
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  std::filesystem::rename(tmp, cache, ec);
+  return !ec;
+}
+
+// The syntax of a built-in language, highlighted by kernel. Its keyword
+// table is still compiled for what else looks at it.
+template <typename Language>
+static EditorSyntax builtin(Highlighter kernel) {
+  EditorSyntax syntax = {
+    std::string(Language::filetype), {},
+    std::string(Language::singleline_comment_start),
+    std::string(Language::multiline_comment_start),
+    std::string(Language::multiline_comment_end),
+    Language::flags, {}, kernel
+  };
+  for (auto match: Language::filematch) {
+    syntax.filematch.emplace_back(match);
+  }
+  std::vector<std::string> keywords;
+  for (auto& keyword: Language::keywords) {
+    keywords.push_back(std::string(keyword.word) +
+      ((keyword.kind == HL::KEYWORD2) ? "|" : ""));
+  }
+  syntax.keyword_table.compile(keywords);
+  return syntax;
+}
+
+SyntaxDB::SyntaxDB() : syntaxes{}, extensions{}, names{} {
+  add(builtin<CLanguage>(highlightC));
+}
+
+// Adds syntax, or replaces the one with the same filetype. Its extensions
+// are taken over from any syntax that already claimed them.
+void SyntaxDB::add(EditorSyntax&& syntax) {
+  std::size_t k = 0;
+  while (k < syntaxes.size() && syntaxes[k].filetype != syntax.filetype) {
+    k++;
+  }
+  if (k == syntaxes.size()) {
+    syntaxes.push_back(std::move(syntax));
+  } else {
+    syntaxes[k] = std::move(syntax);
+    for (auto it = extensions.begin(); it != extensions.end(); ) {
+      it = (it->second == k) ? extensions.erase(it) : std::next(it);
+    }
+    names.erase(std::remove_if(names.begin(), names.end(),
+      [k](auto& name) { return name.second == k; }), names.end());
+  }
+
+  for (auto& match: syntaxes[k].filematch) {
+    if (match.empty()) {
+      continue;
+    }
+    if (match[0] == '.') {
+      extensions[match] = k;
+    } else {
+      names.emplace_back(match, k);
+    }
+  }
+}
+
+const EditorSyntax* SyntaxDB::find(const std::filesystem::path& file) const {
+  auto ext = file.extension().native();
+  auto fn = file.filename().native();
+
+  if (!ext.empty() && ext != fn) {
+    auto it = extensions.find(ext);
+    if (it != extensions.end()) {
+      return &syntaxes[it->second];
+    }
+  }
+  for (auto& [name, k]: names) {
+    if (fn.find(name) != std::string::npos) {
+      return &syntaxes[k];
+    }
+  }
+  return nullptr;
+}
+
+// Adds the definitions in the *.syntax files of dir, in name order so a
+// later file wins an extension two of them claim. Their compiled tables
+// are kept in cache and read from there instead while no file has been
+// added, removed or touched. Returns how many definitions were added.
+std::size_t SyntaxDB::load(const std::filesystem::path& dir,
+const std::filesystem::path& cache) {
+  std::error_code ec;
+  std::vector<std::filesystem::path> files;
+  for (auto& entry: std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.path().extension() == SYNTAX_EXTENSION) {
+      files.push_back(entry.path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::string key = SYNTAX_CACHE_MAGIC;
+  std::size_t count = 0;
+  for (auto& file: files) {
+    struct stat st;
+    if (stat(file.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+      file.clear();
+      continue;
+    }
+    key += file.filename().native();
+    key += '\0';
+    key += std::to_string(st.st_mtim.tv_sec);
+    key += '.';
+    key += std::to_string(st.st_mtim.tv_nsec);
+    key += '\0';
+    key += std::to_string(st.st_size);
+    key += '\n';
+    count++;
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  std::vector<EditorSyntax> found;
+  if (cache.empty() || !readCache(cache, key, found)) {
+    found.clear();
+    for (auto& file: files) {
+      EditorSyntax syntax = { {}, {}, {}, {}, {}, 0, {},
+        highlightGeneric };
+      if (!file.empty() && parseSyntax(file, syntax)) {
+        found.push_back(std::move(syntax));
+      }
+    }
+    if (!cache.empty()) {
+      writeCache(cache, key, found);
+    }
+  }
+
+  for (auto& syntax: found) {
+    add(std::move(syntax));
+  }
+  return found.size();
+}
+
+// Reads a definition made of lines like these, blank lines and lines
+// starting with # aside:
+//
+//   filetype c
+//   match .c .h
+//   keywords if else while
+//   types int char
+//   comment //
+//   multiline /* */
+//   highlight numbers strings
+//
+// Types are highlighted as secondary keywords. Fails on a line it does not
+// know or if the filetype or matches are missing.
+bool parseSyntax(const std::filesystem::path& file, EditorSyntax& syntax) {
+  std::ifstream in(file);
+  if (!in) {
+    return false;
+  }
+
+  std::vector<std::string> keywords;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream words(line);
+    std::string directive, word;
+    if (!(words >> directive) || directive[0] == '#') {
+      continue;
+    }
+
+    if (directive == "filetype") {
+      words >> syntax.filetype;
+    } else if (directive == "match") {
+      while (words >> word) {
+        syntax.filematch.push_back(word);
+      }
+    } else if (directive == "keywords" || directive == "types") {
+      while (words >> word) {
+        keywords.push_back((directive == "types") ? word + "|" : word);
+      }
+    } else if (directive == "comment") {
+      words >> syntax.singleline_comment_start;
+    } else if (directive == "multiline") {
+      words >> syntax.multiline_comment_start >>
+        syntax.multiline_comment_end;
+    } else if (directive == "highlight") {
+      while (words >> word) {
+        if (word == "numbers") {
+          syntax.flags |= HL_HIGHLIGHT_NUMBERS;
+        } else if (word == "strings") {
+          syntax.flags |= HL_HIGHLIGHT_STRINGS;
+        } else {
+          return false;
+        }
+      }
+    } else {
+      return false;
+    }
+  }
+
+  if (syntax.filetype.empty() || syntax.filematch.empty()) {
+    return false;
+  }
+  syntax.keyword_table.compile(keywords);
+  return true;
+}
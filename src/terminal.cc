@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "terminal.h"
+
+constexpr const int TERMINAL_REPLY_TIMEOUT = 1000;
+
+// Written to by the SIGWINCH handler so a resize wakes poll.
+static int winch_pipe[2] = { -1, -1 };
+
+static void onResize(int) {
+  int saved = errno;
+  if (::write(winch_pipe[1], "", 1) == -1) {
+    // The pipe is full, so a wakeup is already pending.
+  }
+  errno = saved;
+}
+
+Terminal::~Terminal() {
+}
+
+bool Terminal::present(const char* s, std::size_t len) {
+  return len == 0 || write(s, len);
+}
+
+TTYTerminal::TTYTerminal() : orig_termios{}, orig_winch{} {
+}
+
+bool TTYTerminal::disableRawMode() {
+  if (winch_pipe[0] != -1) {
+    sigaction(SIGWINCH, &orig_winch, nullptr);
+    close(winch_pipe[0]);
+    close(winch_pipe[1]);
+    winch_pipe[0] = winch_pipe[1] = -1;
+  }
+  if (!write("\x1b[?2004l", 8)) {
+    return false;
+  }
+  return tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) != -1;
+}
+
+bool TTYTerminal::enableRawMode() {
+  if (tcgetattr(STDIN_FILENO, &orig_termios) == -1) {
+    return false;
+  }
+
+  struct termios raw = orig_termios;
+  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+  raw.c_oflag &= ~(OPOST);
+  raw.c_cflag |= (CS8);
+  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+  raw.c_cc[VMIN] = 0;
+  raw.c_cc[VTIME] = 0;
+
+  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
+    return false;
+  }
+
+  if (pipe(winch_pipe) == -1) {
+    return false;
+  }
+  for (auto fd: winch_pipe) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  struct sigaction sa{};
+  sa.sa_handler = onResize;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(SIGWINCH, &sa, &orig_winch) == -1) {
+    return false;
+  }
+
+  return write("\x1b[?2004h", 8);
+}
+
+bool TTYTerminal::getCursorPosition(int& rows, int& cols) {
+
+  if (!write("\x1b[6n", 4)) {
+    return false;
+  }
+
+  char buf[32];
+  unsigned int i = 0;
+
+  struct pollfd in = { STDIN_FILENO, POLLIN, 0 };
+  while (i < sizeof(buf) - 1) {
+    if (::poll(&in, 1, TERMINAL_REPLY_TIMEOUT) != 1 ||
+    ::read(STDIN_FILENO, &buf[i], 1) != 1) {
+      break;
+    }
+    if (buf[i] == 'R') {
+      break;
+    }
+    i++;
+  }
+  buf[i] = '\0';
+
+  if (buf[0] != '\x1b' || buf[1] != '[') {
+    return false;
+  }
+  if (sscanf(&buf[2], "%d;%d", &rows, &cols) != 2) {
+    return false;
+  }
+
+  return true;
+}
+
+bool TTYTerminal::getWindowSize(int& rows, int& cols) {
+  struct winsize ws;
+
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+    if (!write("\x1b[999C\x1b[999B", 12)) {
+      return false;
+    }
+    return getCursorPosition(rows, cols);
+  } else {
+    cols = ws.ws_col;
+    rows = ws.ws_row;
+    return true;
+  }
+}
+
+// Blocks for up to timeout milliseconds, or for good if it is negative,
+// until there is input or the window has been resized.
+int TTYTerminal::poll(int timeout) {
+  struct pollfd fds[2] = {
+    { STDIN_FILENO, POLLIN, 0 },
+    { winch_pipe[0], POLLIN, 0 }
+  };
+  if (::poll(fds, (winch_pipe[0] != -1) ? 2 : 1, timeout) == -1) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+
+  int ready = 0;
+  if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+    ready |= READABLE;
+  }
+  if (fds[1].revents & POLLIN) {
+    char buf[64];
+    while (::read(winch_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+    ready |= RESIZED;
+  }
+  return ready;
+}
+
+ssize_t TTYTerminal::read(char* buf, std::size_t len) {
+  return ::read(STDIN_FILENO, buf, len);
+}
+
+bool TTYTerminal::write(const char* s, std::size_t len) {
+  return ::write(STDOUT_FILENO, s, len) == static_cast<ssize_t>(len);
+}
+
+ScriptTerminal::ScriptTerminal(int r, int c) : rows{r}, cols{c}, keys{},
+offset{0}, pace{0}, next_due{}, unanswered{}, probe{}, output{}, frames{0},
+stats{} {
+}
+
+// Whether read has anything to hand out right now.
+bool ScriptTerminal::available() const {
+  if (keys.empty()) {
+    return false;
+  }
+  if (offset > 0) {
+    return true;
+  }
+  return (pace.count() == 0) ? unanswered.empty() :
+    std::chrono::steady_clock::now() >= next_due;
+}
+
+bool ScriptTerminal::disableRawMode() {
+  return true;
+}
+
+bool ScriptTerminal::enableRawMode() {
+  return true;
+}
+
+bool ScriptTerminal::getWindowSize(int& r, int& c) {
+  r = rows;
+  c = cols;
+  return true;
+}
+
+bool ScriptTerminal::pending() const {
+  return !keys.empty();
+}
+
+// Unpaced, never blocks: a key is either ready or the script is waiting on
+// the editor. Paced, sleeps until the next key is due if the timeout allows.
+int ScriptTerminal::poll(int timeout) {
+  if (!available() && pace.count() > 0 && !keys.empty() && timeout != 0) {
+    auto until = next_due;
+    if (timeout > 0) {
+      until = std::min(until, std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(timeout));
+    }
+    std::this_thread::sleep_until(until);
+  }
+  return available() ? READABLE : 0;
+}
+
+bool ScriptTerminal::present(const char* s, std::size_t len) {
+  output.append(s, len);
+  frames++;
+  auto now = std::chrono::steady_clock::now();
+  for (auto& key: unanswered) {
+    stats.push_back({ now - key.at, len,
+      probe ? probe() - key.probed : 0 });
+  }
+  unanswered.clear();
+  return true;
+}
+
+void ScriptTerminal::push(std::string_view key) {
+  keys.emplace_back(key);
+}
+
+// Hands out the next key, or the rest of one too long for the caller's
+// buffer. A paced key counts as arrived when it was due, so time it spent
+// queued behind slow frames is part of its latency.
+ssize_t ScriptTerminal::read(char* buf, std::size_t len) {
+  if (!available()) {
+    return 0;
+  }
+
+  if (offset == 0) {
+    auto now = std::chrono::steady_clock::now();
+    unanswered.push_back({ (pace.count() > 0) ? next_due : now,
+      probe ? probe() : 0 });
+    next_due += pace;
+  }
+  const std::string& key = keys.front();
+  auto n = std::min(len, key.length() - offset);
+  memcpy(buf, key.data() + offset, n);
+  offset += n;
+  if (offset == key.length()) {
+    keys.pop_front();
+    offset = 0;
+  }
+  return n;
+}
+
+// Has the keys queued from now on arrive one every interval, starting one
+// interval from now, or as the editor answers them if it is zero.
+void ScriptTerminal::setPace(std::chrono::nanoseconds interval) {
+  pace = interval;
+  next_due = std::chrono::steady_clock::now() + interval;
+}
+
+bool ScriptTerminal::write(const char* s, std::size_t len) {
+  output.append(s, len);
+  return true;
+}
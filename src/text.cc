@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "text.h"
+
+constexpr const std::size_t TEXT_MIN_CAPACITY = 16;
+
+Text::Text() : bytes{nullptr}, size{0}, capacity{0} {
+}
+
+Text::Text(std::string_view s, bool borrow) : bytes{nullptr}, size{0},
+capacity{0} {
+  if (borrow) {
+    bytes = s.data();
+    size = s.length();
+  } else if (!s.empty()) {
+    insert(0, s);
+  }
+}
+
+Text::Text(const Text& other) : bytes{other.bytes}, size{other.size},
+capacity{0} {
+  if (!other.borrowed()) {
+    bytes = nullptr;
+    size = 0;
+    append(other);
+  }
+}
+
+Text::Text(Text&& other) noexcept : bytes{other.bytes}, size{other.size},
+capacity{other.capacity} {
+  other.bytes = nullptr;
+  other.size = other.capacity = 0;
+}
+
+Text::~Text() {
+  if (!borrowed()) {
+    delete[] bytes;
+  }
+}
+
+Text& Text::operator=(const Text& other) {
+  if (this != &other) {
+    *this = Text(other);
+  }
+  return *this;
+}
+
+Text& Text::operator=(Text&& other) noexcept {
+  std::swap(bytes, other.bytes);
+  std::swap(size, other.size);
+  std::swap(capacity, other.capacity);
+  return *this;
+}
+
+const char* Text::begin() const {
+  return data();
+}
+
+bool Text::borrowed() const {
+  return capacity == 0;
+}
+
+const char* Text::data() const {
+  return bytes;
+}
+
+bool Text::empty() const {
+  return size == 0;
+}
+
+const char* Text::end() const {
+  return data() + length();
+}
+
+std::size_t Text::length() const {
+  return size;
+}
+
+std::string Text::substr(std::size_t pos, std::size_t n) const {
+  return std::string(std::string_view(*this).substr(pos, n));
+}
+
+char Text::operator[](std::size_t at) const {
+  return data()[at];
+}
+
+Text::operator std::string_view() const {
+  return std::string_view(bytes, size);
+}
+
+void Text::append(std::string_view s) {
+  insert(size, s);
+}
+
+void Text::erase(std::size_t pos, std::size_t n) {
+  n = std::min<std::size_t>(n, size - pos);
+  if (n == 0) {
+    return;
+  }
+  own();
+  char* p = const_cast<char*>(bytes);
+  memmove(p + pos, p + pos + n, size - pos - n);
+  size -= n;
+}
+
+void Text::insert(std::size_t pos, std::size_t n, char c) {
+  if (n == 0) {
+    return;
+  }
+  reserve(size + n);
+  char* p = const_cast<char*>(bytes);
+  memmove(p + pos + n, p + pos, size - pos);
+  memset(p + pos, c, n);
+  size += n;
+}
+
+void Text::insert(std::size_t pos, std::string_view s) {
+  if (s.empty()) {
+    return;
+  }
+  if (s.data() >= bytes && s.data() < bytes + size) {
+    insert(pos, std::string(s));
+    return;
+  }
+  reserve(size + s.length());
+  char* p = const_cast<char*>(bytes);
+  memmove(p + pos + s.length(), p + pos, size - pos);
+  memcpy(p + pos, s.data(), s.length());
+  size += s.length();
+}
+
+void Text::own() {
+  if (size) {
+    reserve(size);
+  }
+}
+
+// Makes sure the bytes are the Text's own with room for n of them. The
+// buffer doubles as it grows so typing into a row stays cheap.
+void Text::reserve(std::size_t n) {
+  if (!borrowed() && n <= capacity) {
+    return;
+  }
+  std::size_t grown = std::max({ n, TEXT_MIN_CAPACITY,
+    borrowed() ? std::size_t{0} : std::size_t{capacity} * 2 });
+  char* p = new char[grown];
+  if (size) {
+    memcpy(p, bytes, size);
+  }
+  if (!borrowed()) {
+    delete[] bytes;
+  }
+  bytes = p;
+  capacity = grown;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include "timerwheel.h"
+
+constexpr const std::chrono::milliseconds WHEEL_TICK{10};
+
+constexpr const std::size_t WHEEL_SLOTS = 256;
+
+TimerWheel::TimerWheel() : slots(WHEEL_SLOTS), origin{Clock::now()},
+tick{0}, count{0} {
+}
+
+void TimerWheel::cancel(int id) {
+  if (count == 0) {
+    return;
+  }
+  for (auto& slot: slots) {
+    auto end = std::remove_if(slot.begin(), slot.end(),
+      [id](const Timer& timer) { return timer.id == id; });
+    count -= slot.end() - end;
+    slot.erase(end, slot.end());
+  }
+}
+
+bool TimerWheel::empty() const {
+  return count == 0;
+}
+
+// Fires every timer due by now. A callback may schedule more timers.
+void TimerWheel::expire() {
+  auto now = tickAt(Clock::now());
+  if (count == 0) {
+    tick = std::max(tick, now + 1);
+    return;
+  }
+
+  std::vector<Timer> due;
+  for (; tick <= now && count > 0; tick++) {
+    auto& slot = slots[tick % WHEEL_SLOTS];
+    for (auto it = slot.begin(); it != slot.end(); ) {
+      if (it->rounds == 0) {
+        due.push_back(std::move(*it));
+        it = slot.erase(it);
+        count--;
+      } else {
+        it->rounds--;
+        ++it;
+      }
+    }
+  }
+  tick = std::max(tick, now + 1);
+
+  for (auto& timer: due) {
+    timer.fire();
+  }
+}
+
+// Milliseconds until the next timer is due, or -1 if there are none. A
+// timer more than a turn of the wheel away is only woken for at the end of
+// the turn.
+int TimerWheel::next() const {
+  if (count == 0) {
+    return -1;
+  }
+
+  auto ahead = WHEEL_SLOTS;
+  for (std::size_t j = 0; j < WHEEL_SLOTS; j++) {
+    auto& slot = slots[(tick + j) % WHEEL_SLOTS];
+    if (std::any_of(slot.begin(), slot.end(),
+    [](const Timer& timer) { return timer.rounds == 0; })) {
+      ahead = j;
+      break;
+    }
+  }
+
+  auto due = origin + (tick + ahead) * WHEEL_TICK;
+  auto wait = std::chrono::ceil<std::chrono::milliseconds>(due -
+    Clock::now()).count();
+  return std::max<int>(wait, 0);
+}
+
+// Sets timer id, replacing any already set, to call fire after delay.
+void TimerWheel::schedule(int id, Clock::duration delay,
+std::function<void()> fire) {
+  cancel(id);
+  auto due = std::max(tick, tickAt(Clock::now() + delay +
+    WHEEL_TICK - Clock::duration{1}));
+  slots[due % WHEEL_SLOTS].push_back({ id, (due - tick) / WHEEL_SLOTS,
+    std::move(fire) });
+  count++;
+}
+
+std::size_t TimerWheel::tickAt(Clock::time_point when) const {
+  return (when - origin) / WHEEL_TICK;
+}
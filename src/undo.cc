@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cctype>
+#include "undo.h"
+
+constexpr const std::size_t UNDO_LIMIT = 64 << 20;
+
+UndoLog::UndoLog() : arena{}, ops{}, groups{}, current{0}, limit{UNDO_LIMIT},
+depth{0}, started{false}, sealed{true}, open_cx{0}, open_cy{0} {
+}
+
+void UndoLog::add(UndoKind kind, std::size_t row, std::size_t col,
+std::string_view s, bool coalesce) {
+  if (current < groups.size()) {
+    auto first = groups[current].first;
+    arena.resize(ops[first].offset);
+    ops.resize(first);
+    groups.resize(current);
+    sealed = true;
+  }
+
+  if (!started) {
+    started = true;
+    if (coalesce && s.length() == 1 && merge(kind, row, col, s[0])) {
+      return;
+    }
+    trim();
+    groups.push_back({ops.size(), open_cx, open_cy, open_cx, open_cy});
+    current = groups.size();
+    sealed = !coalesce;
+  } else {
+    sealed = true;
+  }
+
+  ops.push_back({row, col, arena.size(), static_cast<std::uint32_t>(s.length()),
+    kind, false});
+  arena.append(s);
+}
+
+void UndoLog::close(std::size_t cx, std::size_t cy) {
+  if (--depth == 0 && started) {
+    groups.back().cx_after = cx;
+    groups.back().cy_after = cy;
+  }
+}
+
+std::size_t UndoLog::last(std::size_t group) const {
+  return (group + 1 < groups.size()) ? groups[group + 1].first : ops.size();
+}
+
+bool UndoLog::merge(UndoKind kind, std::size_t row, std::size_t col, char c) {
+  if (sealed || groups.empty()) {
+    return false;
+  }
+
+  UndoOp& op = ops.back();
+  if (op.kind != kind || op.row != row || op.length == UINT32_MAX) {
+    return false;
+  }
+  if (isspace(c) && !isspace(arena.back())) {
+    return false;
+  }
+
+  if (kind == UndoKind::INSERT) {
+    if (op.col + op.length != col) {
+      return false;
+    }
+  } else if (kind == UndoKind::ERASE) {
+    if (col + 1 == op.col && (op.length == 1 || op.reversed)) {
+      op.col = col;
+      op.reversed = true;
+    } else if (col != op.col || op.reversed) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  op.length++;
+  arena += c;
+  return true;
+}
+
+std::size_t UndoLog::memory() const {
+  return arena.capacity() + ops.capacity() * sizeof(UndoOp) +
+    groups.capacity() * sizeof(UndoGroup);
+}
+
+void UndoLog::open(std::size_t cx, std::size_t cy) {
+  if (depth++ == 0) {
+    started = false;
+    open_cx = cx;
+    open_cy = cy;
+  }
+}
+
+std::string UndoLog::text(const UndoOp& op) const {
+  std::string s = arena.substr(op.offset, op.length);
+  if (op.reversed) {
+    std::reverse(s.begin(), s.end());
+  }
+  return s;
+}
+
+// Once the log outgrows its limit, the oldest groups are dropped until it
+// is back under half the limit, so the cost of compacting is amortized.
+void UndoLog::trim() {
+  auto used = arena.size() + ops.size() * sizeof(UndoOp) +
+    groups.size() * sizeof(UndoGroup);
+  if (used <= limit) {
+    return;
+  }
+
+  std::size_t drop = 0;
+  while (drop < groups.size() && used > limit / 2) {
+    auto first = groups[drop].first;
+    auto end = last(drop);
+    auto bytes = (end < ops.size()) ? ops[end].offset : arena.size();
+    used -= bytes - ops[first].offset + (end - first) * sizeof(UndoOp) +
+      sizeof(UndoGroup);
+    drop++;
+  }
+
+  auto first_op = (drop < groups.size()) ? groups[drop].first : ops.size();
+  auto first_byte = (first_op < ops.size()) ? ops[first_op].offset :
+    arena.size();
+  arena.erase(0, first_byte);
+  ops.erase(ops.begin(), ops.begin() + first_op);
+  groups.erase(groups.begin(), groups.begin() + drop);
+  for (auto& op: ops) {
+    op.offset -= first_byte;
+  }
+  for (auto& group: groups) {
+    group.first -= first_op;
+  }
+  current -= drop;
+}